@@ -15,38 +15,46 @@ public:
 
         size_t compact_offset = 0; // Tracks the next free position in memory
 
-        // Create a vector of blocks sorted by their current addresses
-        std::vector<std::pair<int, MemoryBlock>> sorted_blocks(allocations.begin(), allocations.end());
-        std::sort(sorted_blocks.begin(), sorted_blocks.end(), [](const auto& a, const auto& b) {
-            return a.second.address < b.second.address;
+        // Create a vector of blocks sorted by their current addresses. It points into the
+        // allocations map so the new addresses are written back to the real blocks.
+        std::vector<std::pair<const int, MemoryBlock>*> sorted_blocks;
+        sorted_blocks.reserve(allocations.size());
+        for (auto& entry : allocations) {
+            sorted_blocks.push_back(&entry);
+        }
+        std::sort(sorted_blocks.begin(), sorted_blocks.end(), [](const auto* a, const auto* b) {
+            return a->second.address < b->second.address;
         });
 
         // Process blocks in sorted order
-        for (auto& [block_id, block] : sorted_blocks) {
-            if (block.ref_count > 0) { // Only move allocated blocks
-                void* current_address = block.address;
-                void* new_address = reinterpret_cast<char*>(memory_chunk) + compact_offset;
-
-                if (current_address != new_address) {
-                    // Move the block to the compact_offset position
-                    std::memmove(new_address, current_address, block.size);
-
-                    // Log the movement
-                    std::cout << "Block ID " << block_id << " moved from " << current_address << " to " << new_address << std::endl;
-
-                    // Update the block's address
-                    block.address = new_address;
-                } else {
-                    // Log that the block remains in place
-                    std::cout << "Block ID " << block_id << " remains at " << current_address << std::endl;
-                }
-
-                // Update the compact_offset
-                compact_offset += block.size;
+        for (auto* entry : sorted_blocks) {
+            const int block_id = entry->first;
+            MemoryBlock& block = entry->second;
+            // Large blocks have their own mappings and never move; spilled ones are on disk
+            if (block.large || block.spilled) {
+                continue;
+            }
+            // Blocks waiting for the GC still own their bytes, so they are compacted too
+            compact_offset = align_offset(compact_offset, block_alignment(block));
+            void* current_address = block.address;
+            void* new_address = reinterpret_cast<char*>(memory_chunk) + compact_offset;
+
+            if (current_address != new_address) {
+                // Move the block to the compact_offset position
+                std::memmove(new_address, current_address, block.size);
+
+                // Log the movement
+                std::cout << "Block ID " << block_id << " moved from " << current_address << " to " << new_address << std::endl;
+
+                // Update the block's address
+                block.address = new_address;
             } else {
-                // Log that the block is freed
-                std::cout << "Block ID " << block_id << " is freed and not moved." << std::endl;
+                // Log that the block remains in place
+                std::cout << "Block ID " << block_id << " remains at " << current_address << std::endl;
             }
+
+            // Update the compact_offset
+            compact_offset += block.size;
         }
 
         // Update memory_offset to reflect the new end of allocated memory
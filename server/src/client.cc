@@ -1,19 +1,55 @@
 #include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include "proto/hello.grpc.pb.h"
 #include "proto/hello.pb.h"
 #include "parsing/parsing.h"
+#include "script/script_runner.h"
 #include "mpointer/MPointer.h" 
 
 int main(int argc, char* argv[]) {
     // Default server address
     std::string server_address = "0.0.0.0:9999";
 
-    // Check if a custom port is provided as a command-line argument
-    if (argc > 1) {
-        server_address = "0.0.0.0:" + std::string(argv[1]);
+    // Check if a custom port or a full address (e.g. unix:/tmp/mem_mgr.sock) is provided.
+    // A comma-separated list shards the MPointer demo; plain commands use the first server.
+    // --script runs a file of commands instead of the prompt, --window bounds its in-flight calls.
+    std::vector<std::string> server_addresses;
+    std::string script;
+    size_t window = DEFAULT_SCRIPT_WINDOW;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--script" || arg == "--window") && i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--script") {
+            script = argv[++i];
+            continue;
+        }
+        if (arg == "--window") {
+            window = static_cast<size_t>(std::atol(argv[++i]));
+            continue;
+        }
+        std::stringstream targets(arg);
+        std::string target;
+        while (std::getline(targets, target, ',')) {
+            server_addresses.push_back(target.find(':') != std::string::npos ? target : "0.0.0.0:" + target);
+        }
     }
+    if (server_addresses.empty()) {
+        server_addresses.push_back(server_address);
+    }
+    server_address = server_addresses.front();
 
     // Create a channel to connect to the server
     auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
@@ -21,10 +57,25 @@ int main(int argc, char* argv[]) {
     // Create a stub for the MemoryManager service
     std::unique_ptr<memory_manager::MemoryManager::Stub> stub = memory_manager::MemoryManager::NewStub(channel);
 
+    if (!script.empty()) {
+        try {
+            ScriptRunner runner(channel, window);
+            size_t failures = runner.run(script);
+            if (failures > 0) {
+                std::cerr << failures << " commands failed" << std::endl;
+                return 1;
+            }
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     while (true) {
         // Read command from the console
         std::string input;
-        std::cout << "Enter command (linked_list, create, set, get, increaseRefCount, decreaseRefCount, or exit): ";
+        std::cout << "Enter command (linked_list, create, set, get, increaseRefCount, decreaseRefCount, setReference, traverse, benchmark, refbench, export, import, migrate, or exit): ";
         std::getline(std::cin, input);
 
         if (input == "exit") {
@@ -36,12 +87,12 @@ int main(int argc, char* argv[]) {
             auto [command, args] = CommandParser::parseCommand(input);
             if (command == "linked_list") {
                 // Initialize MPointer
-                MPointer<int>::Init("0.0.0.0:9999");
+                MPointer<int>::Init(server_addresses);
 
                 // Create nodes
                 MPointer<int> head = MPointer<int>::New();
-                MPointer<int> second = MPointer<int>::New();
-                MPointer<int> third = MPointer<int>::New();
+                MPointer<int> second = MPointer<int>::NewNear(head);
+                MPointer<int> third = MPointer<int>::NewNear(head);
 
                 // Set values
                 *head = 10;
@@ -52,14 +103,19 @@ int main(int argc, char* argv[]) {
                 head.setNext(second);
                 second.setNext(third);
                 
-                std::cout << "Linked list: " << *head << " -> " << *second << " -> " << *third << " -> " << "null" <<std::endl;
+                // Walk the whole list in one streaming RPC
+                std::cout << "Linked list: ";
+                for (const auto& [id, value] : head.traverse()) {
+                    std::cout << value << " -> ";
+                }
+                std::cout << "null" << std::endl;
                 
             } else if(command == "create") {
                 auto [size, type] = CommandParser::parseCreate(args);
 
                 memory_manager::CreateRequest request;
                 request.set_size(size);
-                request.set_type(type);
+                request.set_type(std::string(type));
 
                 memory_manager::CreateResponse response;
                 grpc::ClientContext context;
@@ -76,7 +132,7 @@ int main(int argc, char* argv[]) {
 
                 memory_manager::SetRequest request;
                 request.set_id(id);
-                request.set_value(value);
+                request.set_value(std::string(value));
 
                 memory_manager::SetResponse response;
                 grpc::ClientContext context;
@@ -135,6 +191,268 @@ int main(int argc, char* argv[]) {
                 } else {
                     std::cerr << "DecreaseRefCount failed: " << status.error_message() << std::endl;
                 }
+            } else if (command == "setReference") {
+                auto [id, slot, target_id] = CommandParser::parseSetReference(args);
+
+                memory_manager::ReferenceRequest request;
+                request.set_id(id);
+                request.set_slot(slot);
+                request.set_target_id(target_id);
+
+                memory_manager::ReferenceResponse response;
+                grpc::ClientContext context;
+
+                grpc::Status status = stub->SetReference(&context, request, &response);
+                if (status.ok()) {
+                    std::cout << "Message: " << response.message() << std::endl;
+                } else {
+                    std::cerr << "SetReference failed: " << status.error_message() << std::endl;
+                }
+            } else if (command == "traverse") {
+                auto [head_id, limit] = CommandParser::parseTraverse(args);
+
+                memory_manager::TraverseRequest request;
+                request.set_head_id(head_id);
+                request.set_slot(0);
+                request.set_limit(limit);
+
+                grpc::ClientContext context;
+                auto reader = stub->Traverse(&context, request);
+
+                memory_manager::TraverseResponse response;
+                while (reader->Read(&response)) {
+                    std::cout << "ID = " << response.id() << ", Value = " << response.value()
+                              << ", Next = " << response.next_id() << std::endl;
+                }
+
+                grpc::Status status = reader->Finish();
+                if (!status.ok()) {
+                    std::cerr << "Traverse failed: " << status.error_message() << std::endl;
+                }
+            } else if (command == "benchmark") {
+                int iterations = CommandParser::parseBenchmark(args);
+
+                // Round-trip latency of Get against one block, to compare TCP and unix: addresses
+                memory_manager::CreateRequest create_request;
+                create_request.set_size(sizeof(int));
+                create_request.set_type("int");
+                memory_manager::CreateResponse create_response;
+                grpc::ClientContext create_context;
+                grpc::Status status = stub->Create(&create_context, create_request, &create_response);
+                if (!status.ok() || !create_response.success()) {
+                    std::cerr << "Benchmark failed: could not create a block" << std::endl;
+                    continue;
+                }
+
+                memory_manager::GetRequest request;
+                request.set_id(create_response.id());
+                std::vector<double> latencies_us;
+                latencies_us.reserve(iterations);
+                for (int i = 0; i < iterations; ++i) {
+                    memory_manager::GetResponse response;
+                    grpc::ClientContext context;
+                    auto start = std::chrono::steady_clock::now();
+                    status = stub->Get(&context, request, &response);
+                    auto end = std::chrono::steady_clock::now();
+                    if (!status.ok()) {
+                        std::cerr << "Benchmark failed: " << status.error_message() << std::endl;
+                        break;
+                    }
+                    latencies_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                }
+
+                // Give the block back so the server can collect it
+                memory_manager::RefCountRequest release_request;
+                release_request.set_id(create_response.id());
+                memory_manager::RefCountResponse release_response;
+                grpc::ClientContext release_context;
+                stub->DecreaseRefCount(&release_context, release_request, &release_response);
+
+                if (!latencies_us.empty()) {
+                    std::sort(latencies_us.begin(), latencies_us.end());
+                    double total = 0;
+                    for (double latency : latencies_us) {
+                        total += latency;
+                    }
+                    std::cout << "Benchmark against " << server_address << ": " << latencies_us.size() << " Gets"
+                              << ", avg " << total / latencies_us.size() << " us"
+                              << ", p50 " << latencies_us[latencies_us.size() / 2] << " us"
+                              << ", p99 " << latencies_us[latencies_us.size() * 99 / 100] << " us" << std::endl;
+                }
+            } else if (command == "refbench") {
+                auto [max_threads, iterations] = CommandParser::parseRefBenchmark(args);
+
+                // Ref count throughput on one shared block, from 1 thread up to max_threads
+                memory_manager::CreateRequest create_request;
+                create_request.set_size(sizeof(int));
+                create_request.set_type("int");
+                memory_manager::CreateResponse create_response;
+                grpc::ClientContext create_context;
+                grpc::Status status = stub->Create(&create_context, create_request, &create_response);
+                if (!status.ok() || !create_response.success()) {
+                    std::cerr << "Refbench failed: could not create a block" << std::endl;
+                    continue;
+                }
+
+                memory_manager::RefCountRequest request;
+                request.set_id(create_response.id());
+                std::vector<int> thread_counts;
+                for (int threads = 1; threads < max_threads; threads *= 2) {
+                    thread_counts.push_back(threads);
+                }
+                thread_counts.push_back(max_threads);
+                for (int threads : thread_counts) {
+                    // Each iteration takes a reference and gives it back, so the block outlives the run
+                    std::atomic<size_t> failures{0};
+                    std::vector<std::thread> workers;
+                    auto start = std::chrono::steady_clock::now();
+                    for (int t = 0; t < threads; ++t) {
+                        workers.emplace_back([&] {
+                            for (int i = 0; i < iterations; ++i) {
+                                memory_manager::RefCountResponse response;
+                                grpc::ClientContext increase_context;
+                                grpc::ClientContext decrease_context;
+                                if (!stub->IncreaseRefCount(&increase_context, request, &response).ok() ||
+                                    !stub->DecreaseRefCount(&decrease_context, request, &response).ok()) {
+                                    failures++;
+                                }
+                            }
+                        });
+                    }
+                    for (std::thread& worker : workers) {
+                        worker.join();
+                    }
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    std::cout << "Refbench " << threads << " threads: "
+                              << 2.0 * threads * iterations / seconds << " ref count ops/s";
+                    if (failures > 0) {
+                        std::cout << ", " << failures << " failed";
+                    }
+                    std::cout << std::endl;
+                }
+
+                memory_manager::RefCountResponse release_response;
+                grpc::ClientContext release_context;
+                stub->DecreaseRefCount(&release_context, request, &release_response);
+            } else if (command == "export") {
+                // Saves the heap to a file, one length-prefixed frame after another
+                std::string path(CommandParser::parseTarget(args));
+                std::ofstream file(path, std::ios::binary);
+                if (!file) {
+                    std::cerr << "Export failed: could not open " << path << std::endl;
+                    continue;
+                }
+
+                memory_manager::ExportRequest request;
+                grpc::ClientContext context;
+                auto reader = stub->Export(&context, request);
+
+                memory_manager::HeapFrame frame;
+                std::string buffer;
+                size_t blocks = 0;
+                size_t bytes = 0;
+                while (reader->Read(&frame)) {
+                    frame.SerializeToString(&buffer);
+                    uint32_t length = static_cast<uint32_t>(buffer.size());
+                    file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                    blocks += frame.blocks_size();
+                    bytes += frame.data().size();
+                }
+
+                grpc::Status status = reader->Finish();
+                if (!status.ok()) {
+                    std::cerr << "Export failed: " << status.error_message() << std::endl;
+                } else if (!file.flush()) {
+                    std::cerr << "Export failed: could not write " << path << std::endl;
+                } else {
+                    std::cout << "Exported " << blocks << " blocks, " << bytes << " bytes to " << path << std::endl;
+                }
+            } else if (command == "import" || command == "migrate") {
+                // import(path) loads a file written by export; migrate(address) streams this
+                // server's heap straight into another one. The blocks keep their ref counts,
+                // which belong to whoever held them before: the id mapping, written to
+                // ids_file or printed, tells those holders which ids to release instead.
+                auto [target_view, ids_view] = CommandParser::parseImport(args);
+                std::string target(target_view);
+                std::string ids_file(ids_view);
+                std::unique_ptr<memory_manager::MemoryManager::Stub> destination;
+                if (command == "migrate") {
+                    std::string address = target.find(':') != std::string::npos ? target : "0.0.0.0:" + target;
+                    destination = memory_manager::MemoryManager::NewStub(
+                        grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+                }
+                memory_manager::MemoryManager::Stub* importer = destination ? destination.get() : stub.get();
+
+                memory_manager::ImportResponse response;
+                grpc::ClientContext import_context;
+                auto writer = importer->Import(&import_context, &response);
+
+                memory_manager::HeapFrame frame;
+                std::string error;
+                if (command == "import") {
+                    std::ifstream file(target, std::ios::binary);
+                    if (!file) {
+                        error = "could not open " + target;
+                    }
+                    uint32_t length;
+                    std::string buffer;
+                    while (error.empty() && file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+                        buffer.resize(length);
+                        if (!file.read(buffer.data(), length) || !frame.ParseFromString(buffer)) {
+                            error = target + " is truncated or corrupt";
+                        } else if (!writer->Write(frame)) {
+                            break; // The server stopped reading; its reply says why
+                        }
+                    }
+                } else {
+                    memory_manager::ExportRequest request;
+                    grpc::ClientContext export_context;
+                    auto reader = stub->Export(&export_context, request);
+                    while (reader->Read(&frame)) {
+                        if (!writer->Write(frame)) {
+                            export_context.TryCancel();
+                            break;
+                        }
+                    }
+                    grpc::Status status = reader->Finish();
+                    if (!status.ok() && status.error_code() != grpc::StatusCode::CANCELLED) {
+                        error = "export from " + server_address + " failed: " + status.error_message();
+                    }
+                }
+
+                // A cancelled stream makes the server drop the blocks it already created
+                if (!error.empty()) {
+                    import_context.TryCancel();
+                }
+                writer->WritesDone();
+                grpc::Status status = writer->Finish();
+                if (!error.empty()) {
+                    std::cerr << "Import failed: " << error << std::endl;
+                } else if (!status.ok()) {
+                    std::cerr << "Import failed: " << status.error_message() << std::endl;
+                } else if (!response.success()) {
+                    std::cerr << response.message() << std::endl;
+                } else {
+                    std::cout << "Imported " << response.new_ids_size() << " blocks, " << response.bytes() << " bytes"
+                              << (command == "migrate" ? " into " + target : "") << std::endl;
+                    std::cout << "Message: " << response.message() << std::endl;
+                    if (!ids_file.empty()) {
+                        std::ofstream ids(ids_file);
+                        for (int i = 0; i < response.new_ids_size(); ++i) {
+                            ids << response.old_ids(i) << " " << response.new_ids(i) << "\n";
+                        }
+                        if (!ids) {
+                            std::cerr << "Failed to write the id mapping to " << ids_file << std::endl;
+                        } else {
+                            std::cout << "Id mapping written to " << ids_file << std::endl;
+                        }
+                    } else {
+                        for (int i = 0; i < response.new_ids_size(); ++i) {
+                            std::cout << "ID " << response.old_ids(i) << " -> " << response.new_ids(i) << std::endl;
+                        }
+                    }
+                }
             } else {
                 std::cerr << "Unknown command: " << command << std::endl;
             }
@@ -0,0 +1,181 @@
+#include "cycle_collector.h"
+#include <iostream>
+#include "../mem_mgr.h"
+
+CycleCollector::CycleCollector(MemoryManager* memory_manager, std::chrono::milliseconds interval,
+                               size_t max_candidates_per_pass)
+    : memory_manager(memory_manager), interval(interval), max_candidates_per_pass(max_candidates_per_pass),
+      should_stop(false), is_running(false) {
+}
+
+CycleCollector::~CycleCollector() {
+    stop();
+}
+
+void CycleCollector::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!is_running) {
+        should_stop = false;
+        cc_thread = std::thread(&CycleCollector::cycle_collection, this);
+        is_running = true;
+        std::cout << "Cycle collector started" << std::endl;
+    }
+}
+
+void CycleCollector::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        should_stop = true;
+    }
+    cv.notify_one();
+
+    if (cc_thread.joinable()) {
+        cc_thread.join();
+    }
+    is_running = false;
+}
+
+void CycleCollector::notify(int id) {
+    bool buffer_full;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!buffered.insert(id).second) {
+            return;
+        }
+        candidates.push_back(id);
+        buffer_full = candidates.size() >= max_candidates_per_pass;
+    }
+
+    // A full buffer doesn't wait for the next interval
+    if (buffer_full) {
+        cv.notify_one();
+    }
+}
+
+void CycleCollector::cycle_collection() {
+    while (!should_stop) {
+        std::vector<int> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, interval, [this] {
+                return candidates.size() >= max_candidates_per_pass || should_stop;
+            });
+            if (should_stop) {
+                break;
+            }
+
+            size_t count = std::min(candidates.size(), max_candidates_per_pass);
+            batch.assign(candidates.begin(), candidates.begin() + count);
+            candidates.erase(candidates.begin(), candidates.begin() + count);
+            for (int id : batch) {
+                buffered.erase(id);
+            }
+        }
+
+        if (batch.empty()) {
+            continue;
+        }
+
+        size_t freed = memory_manager->collect_cycles(batch);
+        if (freed > 0) {
+            std::cout << "Cycle collector reclaimed " << freed << " blocks from "
+                      << batch.size() << " candidates" << std::endl;
+        }
+    }
+}
+
+std::vector<int> CycleCollector::find_garbage(const std::unordered_map<int, MemoryBlock>& allocations,
+                                              const std::vector<int>& candidates) {
+    enum class Color { Gray, White, Black };
+    std::unordered_map<int, Color> colors;
+    // Ref counts with the references from inside the subgraph subtracted
+    std::unordered_map<int, int> trial_counts;
+
+    auto block_of = [&allocations](int id) -> const MemoryBlock* {
+        auto it = allocations.find(id);
+        return it == allocations.end() ? nullptr : &it->second;
+    };
+    auto trial_count = [&](int id) -> int& {
+        auto it = trial_counts.find(id);
+        if (it == trial_counts.end()) {
+            it = trial_counts.emplace(id, block_of(id)->ref_count->load()).first;
+        }
+        return it->second;
+    };
+
+    // Explicit stacks keep long linked structures from overflowing the thread's stack
+    std::vector<int> stack;
+
+    // Mark gray: remove the internal references of everything reachable from the candidates
+    for (int root : candidates) {
+        if (block_of(root) != nullptr) {
+            stack.push_back(root);
+        }
+    }
+    while (!stack.empty()) {
+        int id = stack.back();
+        stack.pop_back();
+        if (colors.count(id) != 0) {
+            continue;
+        }
+        colors[id] = Color::Gray;
+        for (int target_id : block_of(id)->references) {
+            if (target_id != -1 && block_of(target_id) != nullptr) {
+                trial_count(target_id)--;
+                stack.push_back(target_id);
+            }
+        }
+    }
+
+    // Scan black: a block still referenced from outside restores everything it reaches
+    auto scan_black = [&](int start) {
+        std::vector<int> black_stack{start};
+        colors[start] = Color::Black;
+        while (!black_stack.empty()) {
+            int id = black_stack.back();
+            black_stack.pop_back();
+            for (int target_id : block_of(id)->references) {
+                if (target_id != -1 && block_of(target_id) != nullptr) {
+                    trial_count(target_id)++;
+                    if (colors[target_id] != Color::Black) {
+                        colors[target_id] = Color::Black;
+                        black_stack.push_back(target_id);
+                    }
+                }
+            }
+        }
+    };
+
+    // Scan: gray blocks with no external references turn white
+    for (int root : candidates) {
+        if (block_of(root) != nullptr) {
+            stack.push_back(root);
+        }
+    }
+    while (!stack.empty()) {
+        int id = stack.back();
+        stack.pop_back();
+        if (colors[id] != Color::Gray) {
+            continue;
+        }
+        if (trial_count(id) > 0) {
+            scan_black(id);
+        } else {
+            colors[id] = Color::White;
+            for (int target_id : block_of(id)->references) {
+                if (target_id != -1 && block_of(target_id) != nullptr) {
+                    stack.push_back(target_id);
+                }
+            }
+        }
+    }
+
+    // Collect white
+    std::vector<int> garbage;
+    for (const auto& [id, color] : colors) {
+        if (color == Color::White) {
+            garbage.push_back(id);
+        }
+    }
+    return garbage;
+}
@@ -0,0 +1,56 @@
+#ifndef CYCLE_COLLECTOR_H
+#define CYCLE_COLLECTOR_H
+
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../mem_mgr.h"
+#include <atomic>
+#include <mutex>
+
+// Reclaims reference cycles that plain ref counting can't free.
+// Blocks whose count drops but stays above zero are buffered as possible cycle roots;
+// every interval (or when the buffer fills) a batch of them is checked with trial deletion.
+class CycleCollector {
+public:
+    CycleCollector(MemoryManager* memory_manager, std::chrono::milliseconds interval,
+                   size_t max_candidates_per_pass = 256);
+    ~CycleCollector();
+
+    void notify(int id);
+
+    void start();
+    void stop();
+
+    // Trial deletion over the subgraph reachable from candidates. Returns the ids only kept
+    // alive by references from inside that subgraph. Allocations must not change meanwhile.
+    static std::vector<int> find_garbage(const std::unordered_map<int, MemoryBlock>& allocations,
+                                         const std::vector<int>& candidates);
+
+    MemoryManager* memory_manager;
+
+private:
+    void cycle_collection();
+
+    std::thread cc_thread;
+
+    std::mutex mutex;
+
+    // Possible cycle roots, deduplicated
+    std::vector<int> candidates;
+    std::unordered_set<int> buffered;
+
+    std::condition_variable cv;
+
+    // Time between passes and the number of roots examined per pass, which bounds the pause
+    std::chrono::milliseconds interval;
+    size_t max_candidates_per_pass;
+
+    std::atomic<bool> should_stop;
+    std::atomic<bool> is_running;
+};
+
+#endif // CYCLE_COLLECTOR_H
@@ -1,90 +1,79 @@
 #include "garbage_collector.h"
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include "../mem_mgr.h"
+#include "../scheduler/background_scheduler.h"
 
-GarbageCollector::GarbageCollector(MemoryManager* memory_manager)
-    : memory_manager(memory_manager), should_stop(false), is_running(false) {
+GarbageCollector::GarbageCollector(MemoryManager* memory_manager, BackgroundScheduler* scheduler)
+    : memory_manager(memory_manager), scheduler(scheduler), is_running(false) {
 }
 
 GarbageCollector::~GarbageCollector() {
     stop();
+    Pending* node = to_collect.exchange(nullptr);
+    while (node != nullptr) {
+        Pending* next = node->next;
+        delete node;
+        node = next;
+    }
 }
 
 void GarbageCollector::start() {
-    std::lock_guard<std::mutex> lock(mutex);
-    if (!is_running) {
-        should_stop = false;
-        gc_thread = std::thread(&GarbageCollector::garbage_collection, this);
-        is_running = true;
+    if (!is_running.exchange(true)) {
         std::cout << "Garbage collector started" << std::endl;
     }
 }
 
+// Collections already queued still run when the scheduler drains its pools
 void GarbageCollector::stop(){
-    std::lock_guard<std::mutex> lock(mutex);
-    if (is_running) {
-        should_stop = true;
-    }
-    cv.notify_one();
-
-    if (gc_thread.joinable()) {
-        gc_thread.join();
+    if (is_running.exchange(false)) {
+        std::cout <<"Garbage Collector stopped"<< std::endl;
     }
-    is_running = false;
-
-    std::cout <<"Garbage Collector stopped"<< std::endl;
 }
 
 void GarbageCollector::notify(int id) {
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        to_collect.push(id);
-        std::cout << "Object " << id << " up for garbage collection" << std::endl;
+    Pending* node = new Pending{id, to_collect.load(std::memory_order_relaxed)};
+    while (!to_collect.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
     }
-    
-    // Wake up garbage collector to garbage collect
-    cv.notify_one();
-}
-
-void GarbageCollector::garbage_collection(){
-    std::cout << "Garbage collector started" << std::endl;
 
-    while (!should_stop) {
-        std::unique_lock<std::mutex> lock(mutex);
-        
-        // Wait until there's id to collect or asked to stop
-        cv.wait(lock, [this] { 
-            return !to_collect.empty() || should_stop; 
-        });
-        
-        // If we're asked to stop and the queue is empty, exit
-        if (should_stop && to_collect.empty()) {
-            break;
+    // Wake up garbage collector to garbage collect. Only the notify that sets the flag
+    // queues a collection; the collection clears it before taking the ids.
+    if (is_running && !collection_queued.exchange(true, std::memory_order_acq_rel)) {
+        if (!scheduler->submit(TaskClass::Gc, [this] { garbage_collection(); })) {
+            collection_queued = false;
         }
+    }
+}
 
-        while(!to_collect.empty()){
-            int id = to_collect.front();
-            to_collect.pop();
-
-            // Perform garbage collection
-            std::cout << "Collecting object " << id << std::endl;
-
-            lock.unlock();
+void GarbageCollector::garbage_collection(){
+    collection_queued.store(false, std::memory_order_release);
 
-            auto& allocations = memory_manager->get_allocations();
-            auto it = allocations.find(id);
+    // Reverse the stack so blocks are collected in the order they reached zero
+    std::vector<int> batch;
+    for (Pending* node = to_collect.exchange(nullptr, std::memory_order_acquire); node != nullptr;) {
+        batch.push_back(node->id);
+        Pending* next = node->next;
+        delete node;
+        node = next;
+    }
+    std::reverse(batch.begin(), batch.end());
 
-            if (it != allocations.end() && it->second.ref_count == 0) {
-                std::cout << "Garbage collecting object " << id << " of type " 
-                          << it->second.type << " with size " << it->second.size << std::endl;
+    size_t collected = 0;
+    for (int id : batch) {
+        // Perform garbage collection
+        std::cout << "Collecting object " << id << std::endl;
 
-                memory_manager->deallocate(id);
-                std::cout << "Memory for object " << id << "ready for defragmentation" << std::endl;
-            }
-            memory_manager->update_dumps();
-            memory_manager->defragment();
-            lock.lock();
-    
+        // The check and the free happen under the memory manager's lock
+        if (memory_manager->deallocate_if_unreferenced(id)) {
+            std::cout << "Garbage collected object " << id << std::endl;
+            ++collected;
         }
     }
+
+    // The holes left behind are compacted on the defrag pool, which also updates the dumps
+    if (collected > 0) {
+        memory_manager->schedule_defragment();
+    }
 }
@@ -1,17 +1,18 @@
 #ifndef GARBAGE_COLLECTOR_H
 
-#include <thread>
 #include <iostream>
-#include <condition_variable>
-#include <functional>
 #include "../mem_mgr.h"
 #include <atomic>
-#include <mutex>
-#include <queue>
 
+class BackgroundScheduler;
+
+// Frees blocks whose count reached zero. Collection runs on the scheduler's gc pool:
+// ids notified while a collection is queued join it, and every collection ends by
+// asking for one compaction instead of compacting after each block. notify() is
+// called from ref count changes that hold no lock, so it takes none either.
 class GarbageCollector {
 public:
-    explicit GarbageCollector(MemoryManager* memory_manager);
+    GarbageCollector(MemoryManager* memory_manager, BackgroundScheduler* scheduler);
     ~GarbageCollector();
 
     void notify(int id);
@@ -24,20 +25,21 @@ public:
 private:
     void garbage_collection();
 
-    std::thread gc_thread;
+    BackgroundScheduler* scheduler;
 
-    // Mutex for thread aka anti-collisions
-    std::mutex mutex;
+    // Ids waiting for the next collection, newest first
+    struct Pending {
+        int id;
+        Pending* next;
+    };
+    std::atomic<Pending*> to_collect{nullptr};
 
-    std::queue<int> to_collect;
-    // Condition variable for signaling the garbage collector
-    std::condition_variable cv;
-    
-    std::atomic<bool> should_stop;
+    // Set while a collection task is queued on the scheduler
+    std::atomic<bool> collection_queued{false};
 
     // Flag to indicate if the garbage collector is running
     std::atomic<bool> is_running;
 
 };
 
-#endif // GARBAGE_COLLECTOR_H
\ No newline at end of file
+#endif // GARBAGE_COLLECTOR_H
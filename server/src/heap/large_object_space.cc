@@ -0,0 +1,70 @@
+#include "large_object_space.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+LargeObjectSpace::LargeObjectSpace(const HeapOptions& options)
+    : options(options),
+      page_size(options.huge_pages == HugePages::Explicit ? EXPLICIT_HUGE_PAGE_SIZE
+                                                           : static_cast<size_t>(sysconf(_SC_PAGESIZE))) {
+}
+
+LargeObjectSpace::~LargeObjectSpace() {
+    clear();
+}
+
+bool LargeObjectSpace::holds(size_t size) const {
+    return options.large_object_threshold > 0 && size >= options.large_object_threshold;
+}
+
+size_t LargeObjectSpace::mapped_size(size_t size) const {
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+void* LargeObjectSpace::allocate(size_t size) {
+    size_t length = mapped_size(size);
+    void* address = MAP_FAILED;
+    if (options.huge_pages == HugePages::Explicit) {
+        address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (address == MAP_FAILED) {
+        address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (address == MAP_FAILED) {
+        std::cerr << "Failed to map a large object of " << size << " bytes: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    apply_memory_policy(address, length, options);
+    if (options.prefault) {
+        prefault(address, length);
+    }
+    mappings[address] = length;
+    mapped_bytes += length;
+    return address;
+}
+
+void LargeObjectSpace::release(void* address) {
+    auto it = mappings.find(address);
+    if (it == mappings.end()) {
+        std::cerr << "Large object at " << address << " is not mapped" << std::endl;
+        return;
+    }
+    munmap(it->first, it->second);
+    mapped_bytes -= it->second;
+    mappings.erase(it);
+}
+
+void LargeObjectSpace::clear() {
+    for (const auto& [address, length] : mappings) {
+        munmap(address, length);
+    }
+    mappings.clear();
+    mapped_bytes = 0;
+}
+
+size_t LargeObjectSpace::used() const {
+    return mapped_bytes;
+}
@@ -0,0 +1,43 @@
+#ifndef LARGE_OBJECT_SPACE_H
+#define LARGE_OBJECT_SPACE_H
+
+#include <cstddef>
+#include <unordered_map>
+#include "memory_policy.h"
+
+// Home of the blocks too big to be worth compacting. Each one gets its own
+// page-aligned mapping, so it never moves and its memory goes straight back to
+// the OS when it is freed instead of leaving a hole for the defragmenter.
+class LargeObjectSpace {
+public:
+    explicit LargeObjectSpace(const HeapOptions& options);
+    ~LargeObjectSpace();
+
+    LargeObjectSpace(const LargeObjectSpace&) = delete;
+    LargeObjectSpace& operator=(const LargeObjectSpace&) = delete;
+
+    // Whether a block of size bytes belongs here. Never true with a threshold of 0.
+    bool holds(size_t size) const;
+
+    // Bytes a block of size bytes takes once rounded to whole pages
+    size_t mapped_size(size_t size) const;
+
+    // Maps a zeroed block, nullptr when the OS refuses
+    void* allocate(size_t size);
+
+    // Unmaps a block returned by allocate()
+    void release(void* address);
+
+    // Unmaps every block
+    void clear();
+
+    size_t used() const;
+
+private:
+    HeapOptions options;
+    size_t page_size;
+    std::unordered_map<void*, size_t> mappings; // Block address to mapped length
+    size_t mapped_bytes = 0;
+};
+
+#endif // LARGE_OBJECT_SPACE_H
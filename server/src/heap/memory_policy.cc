@@ -0,0 +1,128 @@
+#include "memory_policy.h"
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+std::vector<int> parse_id_list(const std::string& list) {
+    std::vector<int> ids;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+// Reads a sysfs list of node or CPU ids
+static std::vector<int> read_id_list(const std::string& path) {
+    std::ifstream file(path);
+    std::string list;
+    if (!std::getline(file, list)) {
+        return {};
+    }
+    return parse_id_list(list);
+}
+
+HugePages parse_huge_pages(const std::string& value) {
+    if (value == "off") {
+        return HugePages::Off;
+    } else if (value == "thp" || value == "transparent") {
+        return HugePages::Transparent;
+    } else if (value == "explicit") {
+        return HugePages::Explicit;
+    }
+    throw std::invalid_argument("--hugepages must be off, thp or explicit, not " + value);
+}
+
+void parse_numa(const std::string& value, HeapOptions& options) {
+    if (value == "interleave") {
+        options.interleave = true;
+        options.numa_node = -1;
+        return;
+    }
+    try {
+        options.numa_node = std::stoi(value);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("--numa must be a node number or interleave, not " + value);
+    }
+    options.interleave = false;
+}
+
+void apply_memory_policy(void* address, size_t length, const HeapOptions& options) {
+    if (options.huge_pages == HugePages::Transparent && madvise(address, length, MADV_HUGEPAGE) == -1) {
+        std::cerr << "Transparent huge pages unavailable: " << std::strerror(errno) << std::endl;
+    }
+
+    if (options.numa_node < 0 && !options.interleave) {
+        return;
+    }
+    std::vector<int> nodes = options.interleave
+        ? read_id_list("/sys/devices/system/node/online")
+        : std::vector<int>{options.numa_node};
+    if (nodes.empty()) {
+        std::cerr << "No NUMA nodes found, memory policy not applied" << std::endl;
+        return;
+    }
+
+    constexpr size_t MASK_BITS = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(1024 / MASK_BITS, 0);
+    for (int node : nodes) {
+        if (node >= 0 && static_cast<size_t>(node) < 1024) {
+            mask[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+        }
+    }
+    // Called through syscall() so the server doesn't need libnuma
+    long result = syscall(SYS_mbind, address, length, options.interleave ? MPOL_INTERLEAVE : MPOL_BIND,
+                          mask.data(), mask.size() * MASK_BITS, 0);
+    if (result == -1) {
+        std::cerr << "Failed to apply NUMA policy: " << std::strerror(errno) << std::endl;
+    }
+}
+
+void prefault(void* address, size_t length) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(address, length, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    // Older kernels: write one byte per page. The heap is zero already, so this changes nothing.
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile char* bytes = static_cast<volatile char*>(address);
+    for (size_t offset = 0; offset < length; offset += static_cast<size_t>(page_size)) {
+        bytes[offset] = 0;
+    }
+}
+
+bool bind_threads_to_node(int node) {
+    std::vector<int> cpus = read_id_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (cpus.empty()) {
+        std::cerr << "No CPUs found for NUMA node " << node << std::endl;
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        std::cerr << "Failed to bind threads to NUMA node " << node << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::cout << "Service threads bound to the " << cpus.size() << " CPUs of NUMA node " << node << std::endl;
+    return true;
+}
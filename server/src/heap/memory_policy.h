@@ -0,0 +1,39 @@
+#ifndef MEMORY_POLICY_H
+#define MEMORY_POLICY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class HugePages { Off, Transparent, Explicit };
+
+// How the heap's memory is backed. The defaults leave everything to the kernel.
+struct HeapOptions {
+    HugePages huge_pages = HugePages::Off;
+    int numa_node = -1;      // Bind the heap (and the service threads) to this node
+    bool interleave = false; // Spread the heap's pages over every online node instead
+    bool prefault = false;   // Touch committed memory up front instead of on first use
+    size_t large_object_threshold = 256 * 1024; // Blocks this big get their own mapping, 0 keeps them in the heap
+};
+
+// Size of an explicit huge page, and the heap's commit unit when they are used
+constexpr size_t EXPLICIT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Parses a list of ids such as "0-3,8,10-11", as sysfs prints CPUs and nodes
+std::vector<int> parse_id_list(const std::string& list);
+
+// Parses the --hugepages and --numa option values; throws std::invalid_argument
+HugePages parse_huge_pages(const std::string& value);
+void parse_numa(const std::string& value, HeapOptions& options);
+
+// Applies the huge page advice and NUMA policy to a range before it is touched
+void apply_memory_policy(void* address, size_t length, const HeapOptions& options);
+
+// Faults a range in so requests never pay for first-touch page faults
+void prefault(void* address, size_t length);
+
+// Restricts the calling thread, and every thread it starts afterwards, to the CPUs of a node.
+// Called from main before any service thread exists.
+bool bind_threads_to_node(int node);
+
+#endif // MEMORY_POLICY_H
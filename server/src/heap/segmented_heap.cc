@@ -0,0 +1,117 @@
+#include "segmented_heap.h"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+size_t SegmentedHeap::round_to_segment(size_t size) const {
+    return (size + segment_size - 1) / segment_size * segment_size;
+}
+
+SegmentedHeap::SegmentedHeap(size_t initial_size, size_t max_size, const HeapOptions& options)
+    : mapping(nullptr), owns_mapping(true), options(options),
+      segment_size(options.huge_pages == HugePages::Explicit ? EXPLICIT_HUGE_PAGE_SIZE : HEAP_SEGMENT_SIZE),
+      initial_size(round_to_segment(initial_size)),
+      capacity(std::max(round_to_segment(max_size), round_to_segment(initial_size))) {
+    // Address space only: nothing is backed until a segment is committed
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    if (options.huge_pages == HugePages::Explicit) {
+        mapping = mmap(nullptr, capacity, PROT_NONE, flags | MAP_HUGETLB, -1, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Explicit huge pages unavailable (" << std::strerror(errno)
+                      << "), using regular pages" << std::endl;
+            this->options.huge_pages = HugePages::Off;
+        }
+    }
+    if (this->options.huge_pages != HugePages::Explicit) {
+        mapping = mmap(nullptr, capacity, PROT_NONE, flags, -1, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to reserve " + std::to_string(capacity) + " bytes: " + std::strerror(errno));
+    }
+    apply_memory_policy(mapping, capacity, this->options);
+    if (!ensure(this->initial_size)) {
+        munmap(mapping, capacity);
+        throw std::runtime_error("Failed to commit the initial " + std::to_string(this->initial_size) + " bytes");
+    }
+}
+
+SegmentedHeap::SegmentedHeap(void* mapping, size_t initial_size, size_t max_size, const HeapOptions& options)
+    : mapping(mapping), owns_mapping(false), options(options), segment_size(HEAP_SEGMENT_SIZE),
+      initial_size(std::min(round_to_segment(initial_size), max_size)),
+      capacity(max_size),
+      committed_size(this->initial_size) {
+    if (this->options.huge_pages == HugePages::Explicit) {
+        std::cerr << "Explicit huge pages can't back a shared chunk, using transparent huge pages" << std::endl;
+        this->options.huge_pages = HugePages::Transparent;
+    }
+    apply_memory_policy(mapping, capacity, this->options);
+    if (this->options.prefault) {
+        prefault(mapping, committed_size);
+    }
+}
+
+SegmentedHeap::~SegmentedHeap() {
+    if (owns_mapping && mapping != nullptr) {
+        munmap(mapping, capacity);
+    }
+}
+
+void* SegmentedHeap::base() const {
+    return mapping;
+}
+
+size_t SegmentedHeap::max_size() const {
+    return capacity;
+}
+
+size_t SegmentedHeap::committed() const {
+    return committed_size;
+}
+
+bool SegmentedHeap::ensure(size_t end_offset) {
+    if (end_offset <= committed_size) {
+        return true;
+    }
+    if (end_offset > capacity) {
+        return false;
+    }
+
+    size_t new_size = std::min(round_to_segment(end_offset), capacity);
+    char* start = static_cast<char*>(mapping) + committed_size;
+    if (owns_mapping && mprotect(start, new_size - committed_size, PROT_READ | PROT_WRITE) == -1) {
+        std::cerr << "Failed to grow heap: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (options.prefault) {
+        prefault(start, new_size - committed_size);
+    }
+    if (committed_size > 0) {
+        std::cout << "Heap grew from " << committed_size << " to " << new_size << " bytes" << std::endl;
+    }
+    committed_size = new_size;
+    return true;
+}
+
+void SegmentedHeap::release_above(size_t end_offset) {
+    size_t keep = std::max(round_to_segment(end_offset), initial_size);
+    if (keep >= committed_size) {
+        return;
+    }
+
+    char* start = static_cast<char*>(mapping) + keep;
+    size_t length = committed_size - keep;
+    if (owns_mapping) {
+        // Drop the pages, then make the range unusable until it is committed again
+        madvise(start, length, MADV_DONTNEED);
+        mprotect(start, length, PROT_NONE);
+    } else {
+        // Frees the pages behind a shared mapping; they read back as zeros
+        madvise(start, length, MADV_REMOVE);
+    }
+    std::cout << "Heap returned " << length << " bytes to the OS, " << keep << " bytes committed" << std::endl;
+    committed_size = keep;
+}
@@ -0,0 +1,51 @@
+#ifndef SEGMENTED_HEAP_H
+#define SEGMENTED_HEAP_H
+
+#include <cstddef>
+#include "memory_policy.h"
+
+// Growth step of the heap, and the unit in which idle memory goes back to the OS
+constexpr size_t HEAP_SEGMENT_SIZE = 1024 * 1024;
+
+// The memory blocks live in. The whole ceiling is reserved as address space up
+// front, so the heap stays one contiguous range and offsets never change when it
+// grows; only the segments in use are committed. Segments past the end of the
+// used memory are handed back to the OS when the heap shrinks.
+class SegmentedHeap {
+public:
+    // Private heap: reserves max_size bytes and commits the first initial_size
+    SegmentedHeap(size_t initial_size, size_t max_size, const HeapOptions& options = {});
+
+    // Heap over memory mapped by someone else (the shared chunk). Untouched pages of
+    // a shared mapping cost nothing, so committing is only bookkeeping there.
+    // Explicit huge pages can't back a shared chunk.
+    SegmentedHeap(void* mapping, size_t initial_size, size_t max_size, const HeapOptions& options = {});
+
+    ~SegmentedHeap();
+
+    SegmentedHeap(const SegmentedHeap&) = delete;
+    SegmentedHeap& operator=(const SegmentedHeap&) = delete;
+
+    void* base() const;
+    size_t max_size() const;
+    size_t committed() const;
+
+    // Commits segments until [0, end_offset) is usable. False when that would pass the ceiling.
+    bool ensure(size_t end_offset);
+
+    // Returns the segments after end_offset to the OS, keeping the initial size
+    void release_above(size_t end_offset);
+
+private:
+    void* mapping;
+    bool owns_mapping;
+    HeapOptions options;
+    size_t segment_size; // HEAP_SEGMENT_SIZE, or a huge page when those back the heap
+    size_t initial_size;
+    size_t capacity;
+    size_t committed_size = 0;
+
+    size_t round_to_segment(size_t size) const;
+};
+
+#endif // SEGMENTED_HEAP_H
@@ -0,0 +1,44 @@
+#include "invalidation_hub.h"
+#include <algorithm>
+#include <iostream>
+
+std::vector<int> InvalidationHub::Subscription::wait(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait_for(lock, timeout, [this] { return !pending.empty(); });
+
+    std::vector<int> ids(pending.begin(), pending.end());
+    pending.clear();
+    return ids;
+}
+
+void InvalidationHub::Subscription::push(int id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.insert(id);
+    }
+    cv.notify_one();
+}
+
+std::shared_ptr<InvalidationHub::Subscription> InvalidationHub::subscribe(const std::string& client_id) {
+    auto subscription = std::make_shared<Subscription>(client_id);
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions.push_back(subscription);
+    std::cout << "Client " << client_id << " subscribed to invalidations" << std::endl;
+    return subscription;
+}
+
+void InvalidationHub::unsubscribe(const std::shared_ptr<Subscription>& subscription) {
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions.erase(std::remove(subscriptions.begin(), subscriptions.end(), subscription),
+                        subscriptions.end());
+    std::cout << "Client " << subscription->client_id << " unsubscribed from invalidations" << std::endl;
+}
+
+void InvalidationHub::publish(int id, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& subscription : subscriptions) {
+        if (origin_client_id.empty() || subscription->client_id != origin_client_id) {
+            subscription->push(id);
+        }
+    }
+}
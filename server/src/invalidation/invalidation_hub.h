@@ -0,0 +1,46 @@
+#ifndef INVALIDATION_HUB_H
+#define INVALIDATION_HUB_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Fans out "this block changed" events to clients caching block values.
+// Each Subscribe stream owns a Subscription; writes are published with the
+// writer's client id so a client isn't told about its own writes.
+class InvalidationHub {
+public:
+    class Subscription {
+    public:
+        explicit Subscription(const std::string& client_id) : client_id(client_id) {}
+
+        // Waits up to timeout for invalidated ids and takes them all
+        std::vector<int> wait(std::chrono::milliseconds timeout);
+
+        const std::string client_id;
+
+    private:
+        friend class InvalidationHub;
+        void push(int id);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::unordered_set<int> pending; // Repeated writes to an id collapse into one event
+    };
+
+    std::shared_ptr<Subscription> subscribe(const std::string& client_id);
+    void unsubscribe(const std::shared_ptr<Subscription>& subscription);
+
+    // Tells every subscriber except origin_client_id that id changed or was freed
+    void publish(int id, const std::string& origin_client_id = "");
+
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Subscription>> subscriptions;
+};
+
+#endif // INVALIDATION_HUB_H
@@ -0,0 +1,328 @@
+#include "kernels.h"
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#define KERNELS_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace kernels {
+
+ElementType element_type(const std::string& type) {
+    if (type == "int") {
+        return ElementType::Int;
+    } else if (type == "float") {
+        return ElementType::Float;
+    } else if (type == "double") {
+        return ElementType::Double;
+    }
+    return ElementType::Unsupported;
+}
+
+size_t element_size(ElementType type) {
+    switch (type) {
+        case ElementType::Int:
+            return sizeof(int32_t);
+        case ElementType::Float:
+            return sizeof(float);
+        case ElementType::Double:
+            return sizeof(double);
+        case ElementType::Unsupported:
+            break;
+    }
+    return 0;
+}
+
+bool has_avx2() {
+#ifdef KERNELS_X86
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+namespace {
+
+// Portable versions, also used for the tails the vector loops leave
+template <typename Acc, typename T>
+Acc sum_scalar(const T* data, size_t count) {
+    Acc total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += data[i];
+    }
+    return total;
+}
+
+template <typename T>
+T min_scalar(const T* data, size_t count, T initial) {
+    for (size_t i = 0; i < count; ++i) {
+        initial = std::min(initial, data[i]);
+    }
+    return initial;
+}
+
+template <typename T>
+T max_scalar(const T* data, size_t count, T initial) {
+    for (size_t i = 0; i < count; ++i) {
+        initial = std::max(initial, data[i]);
+    }
+    return initial;
+}
+
+template <typename T>
+size_t count_greater_scalar(const T* data, size_t count, T threshold) {
+    size_t matches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        matches += data[i] > threshold;
+    }
+    return matches;
+}
+
+template <typename T>
+size_t count_less_scalar(const T* data, size_t count, T threshold) {
+    size_t matches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        matches += data[i] < threshold;
+    }
+    return matches;
+}
+
+template <typename T>
+void add_scalar_scalar(T* data, size_t count, T value) {
+    for (size_t i = 0; i < count; ++i) {
+        data[i] += value;
+    }
+}
+
+template <typename T>
+void scale_scalar(T* data, size_t count, T factor) {
+    for (size_t i = 0; i < count; ++i) {
+        data[i] *= factor;
+    }
+}
+
+#ifdef KERNELS_X86
+
+// One 256-bit register of each element type. The generic AVX2 kernels below are
+// written once against these.
+struct Int32Lanes {
+    using Scalar = int32_t;
+    using Vector = __m256i;
+    static constexpr size_t WIDTH = 8;
+    KERNELS_AVX2 static Vector load(const Scalar* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    KERNELS_AVX2 static void store(Scalar* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    KERNELS_AVX2 static Vector broadcast(Scalar x) { return _mm256_set1_epi32(x); }
+    KERNELS_AVX2 static Vector add(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+    KERNELS_AVX2 static Vector mul(Vector a, Vector b) { return _mm256_mullo_epi32(a, b); }
+    KERNELS_AVX2 static Vector min(Vector a, Vector b) { return _mm256_min_epi32(a, b); }
+    KERNELS_AVX2 static Vector max(Vector a, Vector b) { return _mm256_max_epi32(a, b); }
+    KERNELS_AVX2 static int greater_mask(Vector a, Vector b) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)));
+    }
+};
+
+struct FloatLanes {
+    using Scalar = float;
+    using Vector = __m256;
+    static constexpr size_t WIDTH = 8;
+    KERNELS_AVX2 static Vector load(const Scalar* p) { return _mm256_loadu_ps(p); }
+    KERNELS_AVX2 static void store(Scalar* p, Vector v) { _mm256_storeu_ps(p, v); }
+    KERNELS_AVX2 static Vector broadcast(Scalar x) { return _mm256_set1_ps(x); }
+    KERNELS_AVX2 static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    KERNELS_AVX2 static Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+    KERNELS_AVX2 static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    KERNELS_AVX2 static Vector max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+    KERNELS_AVX2 static int greater_mask(Vector a, Vector b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+};
+
+struct DoubleLanes {
+    using Scalar = double;
+    using Vector = __m256d;
+    static constexpr size_t WIDTH = 4;
+    KERNELS_AVX2 static Vector load(const Scalar* p) { return _mm256_loadu_pd(p); }
+    KERNELS_AVX2 static void store(Scalar* p, Vector v) { _mm256_storeu_pd(p, v); }
+    KERNELS_AVX2 static Vector broadcast(Scalar x) { return _mm256_set1_pd(x); }
+    KERNELS_AVX2 static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    KERNELS_AVX2 static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+    KERNELS_AVX2 static Vector min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+    KERNELS_AVX2 static Vector max(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+    KERNELS_AVX2 static int greater_mask(Vector a, Vector b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)); }
+};
+
+template <typename Lanes, bool Max>
+KERNELS_AVX2 typename Lanes::Scalar extreme_avx2(const typename Lanes::Scalar* data, size_t count) {
+    using Scalar = typename Lanes::Scalar;
+    typename Lanes::Vector best = Lanes::broadcast(data[0]);
+    size_t i = 0;
+    for (; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+        best = Max ? Lanes::max(best, Lanes::load(data + i)) : Lanes::min(best, Lanes::load(data + i));
+    }
+    Scalar lanes[Lanes::WIDTH];
+    Lanes::store(lanes, best);
+    Scalar result = data[0];
+    for (Scalar lane : lanes) {
+        result = Max ? std::max(result, lane) : std::min(result, lane);
+    }
+    return Max ? max_scalar(data + i, count - i, result) : min_scalar(data + i, count - i, result);
+}
+
+template <typename Lanes, bool Greater>
+KERNELS_AVX2 size_t count_avx2(const typename Lanes::Scalar* data, size_t count, typename Lanes::Scalar threshold) {
+    typename Lanes::Vector limit = Lanes::broadcast(threshold);
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+        typename Lanes::Vector values = Lanes::load(data + i);
+        int mask = Greater ? Lanes::greater_mask(values, limit) : Lanes::greater_mask(limit, values);
+        matches += static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(mask)));
+    }
+    return matches + (Greater ? count_greater_scalar(data + i, count - i, threshold)
+                              : count_less_scalar(data + i, count - i, threshold));
+}
+
+template <typename Lanes, bool Multiply>
+KERNELS_AVX2 void update_avx2(typename Lanes::Scalar* data, size_t count, typename Lanes::Scalar operand) {
+    typename Lanes::Vector value = Lanes::broadcast(operand);
+    size_t i = 0;
+    for (; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+        typename Lanes::Vector current = Lanes::load(data + i);
+        Lanes::store(data + i, Multiply ? Lanes::mul(current, value) : Lanes::add(current, value));
+    }
+    if (Multiply) {
+        scale_scalar(data + i, count - i, operand);
+    } else {
+        add_scalar_scalar(data + i, count - i, operand);
+    }
+}
+
+// Sums widen as they go: ints into 64-bit lanes, floats into doubles
+KERNELS_AVX2 int64_t sum_avx2(const int32_t* data, size_t count) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        total = _mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar<int64_t>(data + i, count - i);
+}
+
+KERNELS_AVX2 double sum_avx2(const float* data, size_t count) {
+    __m256d total = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        total = _mm256_add_pd(total, _mm256_cvtps_pd(_mm_loadu_ps(data + i)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar<double>(data + i, count - i);
+}
+
+KERNELS_AVX2 double sum_avx2(const double* data, size_t count) {
+    __m256d total = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        total = _mm256_add_pd(total, _mm256_loadu_pd(data + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar<double>(data + i, count - i);
+}
+
+#endif // KERNELS_X86
+
+} // namespace
+
+#ifdef KERNELS_X86
+#define KERNELS_DISPATCH(avx2_call, scalar_call) return has_avx2() ? (avx2_call) : (scalar_call)
+#else
+#define KERNELS_DISPATCH(avx2_call, scalar_call) return (scalar_call)
+#endif
+
+int64_t sum(const int32_t* data, size_t count) {
+    KERNELS_DISPATCH(sum_avx2(data, count), sum_scalar<int64_t>(data, count));
+}
+
+double sum(const float* data, size_t count) {
+    KERNELS_DISPATCH(sum_avx2(data, count), sum_scalar<double>(data, count));
+}
+
+double sum(const double* data, size_t count) {
+    KERNELS_DISPATCH(sum_avx2(data, count), sum_scalar<double>(data, count));
+}
+
+int32_t min_value(const int32_t* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<Int32Lanes, false>(data, count)), min_scalar(data, count, data[0]));
+}
+
+float min_value(const float* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<FloatLanes, false>(data, count)), min_scalar(data, count, data[0]));
+}
+
+double min_value(const double* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<DoubleLanes, false>(data, count)), min_scalar(data, count, data[0]));
+}
+
+int32_t max_value(const int32_t* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<Int32Lanes, true>(data, count)), max_scalar(data, count, data[0]));
+}
+
+float max_value(const float* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<FloatLanes, true>(data, count)), max_scalar(data, count, data[0]));
+}
+
+double max_value(const double* data, size_t count) {
+    KERNELS_DISPATCH((extreme_avx2<DoubleLanes, true>(data, count)), max_scalar(data, count, data[0]));
+}
+
+size_t count_greater(const int32_t* data, size_t count, int32_t threshold) {
+    KERNELS_DISPATCH((count_avx2<Int32Lanes, true>(data, count, threshold)), count_greater_scalar(data, count, threshold));
+}
+
+size_t count_greater(const float* data, size_t count, float threshold) {
+    KERNELS_DISPATCH((count_avx2<FloatLanes, true>(data, count, threshold)), count_greater_scalar(data, count, threshold));
+}
+
+size_t count_greater(const double* data, size_t count, double threshold) {
+    KERNELS_DISPATCH((count_avx2<DoubleLanes, true>(data, count, threshold)), count_greater_scalar(data, count, threshold));
+}
+
+size_t count_less(const int32_t* data, size_t count, int32_t threshold) {
+    KERNELS_DISPATCH((count_avx2<Int32Lanes, false>(data, count, threshold)), count_less_scalar(data, count, threshold));
+}
+
+size_t count_less(const float* data, size_t count, float threshold) {
+    KERNELS_DISPATCH((count_avx2<FloatLanes, false>(data, count, threshold)), count_less_scalar(data, count, threshold));
+}
+
+size_t count_less(const double* data, size_t count, double threshold) {
+    KERNELS_DISPATCH((count_avx2<DoubleLanes, false>(data, count, threshold)), count_less_scalar(data, count, threshold));
+}
+
+void add_scalar(int32_t* data, size_t count, int32_t value) {
+    KERNELS_DISPATCH((update_avx2<Int32Lanes, false>(data, count, value)), add_scalar_scalar(data, count, value));
+}
+
+void add_scalar(float* data, size_t count, float value) {
+    KERNELS_DISPATCH((update_avx2<FloatLanes, false>(data, count, value)), add_scalar_scalar(data, count, value));
+}
+
+void add_scalar(double* data, size_t count, double value) {
+    KERNELS_DISPATCH((update_avx2<DoubleLanes, false>(data, count, value)), add_scalar_scalar(data, count, value));
+}
+
+void scale(int32_t* data, size_t count, int32_t factor) {
+    KERNELS_DISPATCH((update_avx2<Int32Lanes, true>(data, count, factor)), scale_scalar(data, count, factor));
+}
+
+void scale(float* data, size_t count, float factor) {
+    KERNELS_DISPATCH((update_avx2<FloatLanes, true>(data, count, factor)), scale_scalar(data, count, factor));
+}
+
+void scale(double* data, size_t count, double factor) {
+    KERNELS_DISPATCH((update_avx2<DoubleLanes, true>(data, count, factor)), scale_scalar(data, count, factor));
+}
+
+} // namespace kernels
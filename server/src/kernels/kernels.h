@@ -0,0 +1,51 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Reductions and element-wise updates over the elements of a block, run inside the
+// server so only the result crosses the wire. Every kernel has a portable scalar
+// version; on x86-64 CPUs with AVX2 the vector version is picked at runtime.
+namespace kernels {
+
+enum class ElementType { Int, Float, Double, Unsupported };
+
+// Element type of a block type name, resolved once per request
+ElementType element_type(const std::string& type);
+
+// Bytes of one element the kernels read and write, 0 for Unsupported
+size_t element_size(ElementType type);
+
+bool has_avx2();
+
+int64_t sum(const int32_t* data, size_t count);
+double sum(const float* data, size_t count);
+double sum(const double* data, size_t count);
+
+// count must be at least 1
+int32_t min_value(const int32_t* data, size_t count);
+float min_value(const float* data, size_t count);
+double min_value(const double* data, size_t count);
+int32_t max_value(const int32_t* data, size_t count);
+float max_value(const float* data, size_t count);
+double max_value(const double* data, size_t count);
+
+size_t count_greater(const int32_t* data, size_t count, int32_t threshold);
+size_t count_greater(const float* data, size_t count, float threshold);
+size_t count_greater(const double* data, size_t count, double threshold);
+size_t count_less(const int32_t* data, size_t count, int32_t threshold);
+size_t count_less(const float* data, size_t count, float threshold);
+size_t count_less(const double* data, size_t count, double threshold);
+
+void add_scalar(int32_t* data, size_t count, int32_t value);
+void add_scalar(float* data, size_t count, float value);
+void add_scalar(double* data, size_t count, double value);
+void scale(int32_t* data, size_t count, int32_t factor);
+void scale(float* data, size_t count, float factor);
+void scale(double* data, size_t count, double factor);
+
+} // namespace kernels
+
+#endif // KERNELS_H
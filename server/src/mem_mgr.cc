@@ -6,7 +6,16 @@
 #include <getopt.h>
 #include <cstdlib>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <type_traits>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <random>
 #include "dumps/dumps.h"
 #include "mem_mgr.h"
 #include "services/create/create_service.h"
@@ -16,26 +25,39 @@
 #include "services/decrease_ref/decrease_ref_service.h"
 #include "services/utils.h"
 #include "garbage_collector/garbage_collector.h"
+#include "cycle_collector/cycle_collector.h"
+#include "invalidation/invalidation_hub.h"
+#include "replication/replication_log.h"
+#include "sessions/session_reaper.h"
+#include "scheduler/background_scheduler.h"
 #include "Defragmenter/Defragmenter.h"
+#include "kernels/kernels.h"
 
 
-MemoryManager::MemoryManager(size_t size_mb, const std::string& folder)
-    : memory_chunk_size(size_mb * 1024 * 1024),
+// The heap starts at size_mb and grows on demand up to max_size_mb (0 keeps it at size_mb)
+MemoryManager::MemoryManager(size_t size_mb, const std::string& folder, const std::string& shm_name, size_t max_size_mb,
+                             const HeapOptions& heap_options, bool spill_to_disk)
+    : memory_chunk_size(std::max(size_mb, max_size_mb) * 1024 * 1024),
       dumps(folder, memory_chunk_size) {
-    memory_chunk = malloc(memory_chunk_size);
-    if (!memory_chunk) {
-        std::cerr << "Failed to allocate " << size_mb << "MB of memory" << std::endl;
-        exit(1);
+    // Both mappings are page aligned, so array blocks on ARRAY_ALIGNMENT offsets are aligned in memory too
+    if (!shm_name.empty()) {
+        shared_chunk = std::make_unique<SharedMemoryChunk>(shm_name, memory_chunk_size);
+        heap = std::make_unique<SegmentedHeap>(shared_chunk->data(), size_mb * 1024 * 1024, memory_chunk_size, heap_options);
+    } else {
+        heap = std::make_unique<SegmentedHeap>(size_mb * 1024 * 1024, memory_chunk_size, heap_options);
+    }
+    memory_chunk = heap->base();
+    large_objects = std::make_unique<LargeObjectSpace>(heap_options);
+    if (spill_to_disk) {
+        spill_file = std::make_unique<SpillFile>((std::filesystem::absolute(folder) / "spill.bin").string());
     }
-    std::cout << "Allocated " << size_mb << "MB of memory" << std::endl;
+    std::cout << "Allocated " << size_mb << "MB of memory, growing up to " << memory_chunk_size / (1024 * 1024)
+              << "MB" << std::endl;
     dumps.update(0, memory_chunk_size, 0, next_id); // Initialize the dump file
 }
 
-MemoryManager::~MemoryManager() {
-    if (memory_chunk) {
-        free(memory_chunk);
-    }
-}
+// The heap and the shared chunk unmap themselves
+MemoryManager::~MemoryManager() = default;
 
 void* MemoryManager::get_memory_chunk() const {
     return memory_chunk;
@@ -45,71 +67,557 @@ size_t MemoryManager::get_memory_chunk_size() const {
     return memory_chunk_size;
 }
 
+size_t MemoryManager::get_committed_memory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return heap->committed();
+}
+
+size_t MemoryManager::get_memory_offset() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_offset;
+}
+
+size_t MemoryManager::get_free_memory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_chunk_size - memory_offset - large_objects->used();
+}
+
 void MemoryManager::update_dumps() {
-    size_t used_memory = memory_offset;
-    size_t free_memory = memory_chunk_size - memory_offset;
+    std::lock_guard<std::mutex> lock(mutex);
+    update_dumps_locked();
+}
+
+void MemoryManager::update_dumps_locked() {
+    if (scheduler != nullptr) {
+        schedule_dump_locked(false);
+        return;
+    }
+    size_t used_memory = memory_offset + large_objects->used();
+    size_t free_memory = memory_chunk_size - used_memory;
     dumps.update(used_memory, free_memory, allocations.size(), next_id);
 }
 
+// Hands the dump files to the dump pool. Dumps asked for while one is queued fold
+// into it, so a burst of requests writes the files once, and the file I/O happens
+// outside the mutex. Must be called with the mutex held.
+void MemoryManager::schedule_dump_locked(bool detailed) {
+    detailed_dump_requested = detailed_dump_requested || detailed;
+    if (dump_queued) {
+        return;
+    }
+    dump_queued = scheduler->submit(TaskClass::Dump, [this] {
+        size_t used_memory, free_memory, blocks;
+        int next;
+        std::string detailed_state;
+        bool write_detailed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dump_queued = false;
+            write_detailed = detailed_dump_requested;
+            detailed_dump_requested = false;
+            used_memory = memory_offset + large_objects->used();
+            free_memory = memory_chunk_size - used_memory;
+            blocks = allocations.size();
+            next = next_id;
+            if (write_detailed) {
+                detailed_state = format_memory_state_locked();
+            }
+        }
+
+        std::lock_guard<std::mutex> io_lock(dump_mutex);
+        dumps.update(used_memory, free_memory, blocks, next);
+        if (write_detailed) {
+            dumps.create_detailed_dump_file(detailed_state);
+        }
+    });
+    if (!dump_queued) {
+        // The pools are shutting down; write it here
+        std::lock_guard<std::mutex> io_lock(dump_mutex);
+        size_t used_memory = memory_offset + large_objects->used();
+        dumps.update(used_memory, memory_chunk_size - used_memory, allocations.size(), next_id);
+        if (detailed_dump_requested) {
+            dumps.create_detailed_dump_file(format_memory_state_locked());
+            detailed_dump_requested = false;
+        }
+    }
+}
+
 void MemoryManager::defragment() {
+    std::lock_guard<std::mutex> lock(mutex);
+    defragment_locked();
+}
+
+void MemoryManager::schedule_defragment() {
+    std::lock_guard<std::mutex> lock(mutex);
+    request_compaction_locked();
+}
+
+// Compacts on the defrag pool when there is one, otherwise right away. Requests made
+// while a compaction is queued are served by it. Must be called with the mutex held.
+void MemoryManager::request_compaction_locked() {
+    if (scheduler == nullptr) {
+        defragment_locked();
+        return;
+    }
+    if (compaction_queued) {
+        return;
+    }
+    compaction_queued = scheduler->submit(TaskClass::Defrag, [this] {
+        std::lock_guard<std::mutex> lock(mutex);
+        compaction_queued = false;
+        defragment_locked();
+        update_dumps_locked();
+    });
+    if (!compaction_queued) {
+        defragment_locked();
+    }
+}
+
+// Clients reading the shared chunk directly must see the moves. Must be called with the mutex held.
+void MemoryManager::defragment_locked() {
+    if (shared_chunk) {
+        shared_chunk->begin_move();
+    }
     Defragmenter::defragment(memory_chunk, memory_chunk_size, allocations, memory_offset);
+    if (shared_chunk) {
+        shared_chunk->end_move();
+    }
+
+    // Segments the compaction emptied go back to the OS
+    heap->release_above(memory_offset);
+}
+
+// Whether the heap can extend to heap_end and large_bytes more of large objects can be
+// mapped, both counted against the one ceiling. Commits the heap segments if so.
+// Must be called with the mutex held.
+bool MemoryManager::has_room_locked(size_t heap_end, size_t large_bytes) {
+    if (heap_end + large_objects->used() + large_bytes > memory_chunk_size) {
+        return false;
+    }
+    return heap->ensure(heap_end);
+}
+
+// A large block's mapping goes straight back to the OS; a heap block is zeroed and
+// stays a hole until the next compaction; a spilled one frees its extent of the file.
+// Must be called with the mutex held.
+void MemoryManager::release_block_memory_locked(MemoryBlock& block) {
+    if (block.spilled) {
+        spill_file->release(block.spill_offset, block.size);
+    } else if (block.large) {
+        large_objects->release(block.address);
+    } else {
+        std::memset(block.address, 0, block.size);
+    }
+}
+
+// Compacts, then spills cold blocks until heap_bytes more of the heap and large_bytes
+// more of large objects fit. Without a spill file only the compaction is tried. Blocks
+// in keep are never spilled. Must be called with the mutex held.
+bool MemoryManager::make_room_locked(size_t heap_bytes, size_t large_bytes, const std::vector<int>& keep) {
+    defragment_locked();
+    while (!has_room_locked(memory_offset + heap_bytes, large_bytes)) {
+        size_t needed = memory_offset + heap_bytes + large_objects->used() + large_bytes;
+        size_t missing = needed > memory_chunk_size ? needed - memory_chunk_size : heap_bytes + large_bytes;
+        if (spill_file == nullptr || !evict_locked(missing, keep)) {
+            return false;
+        }
+        defragment_locked();
+    }
+    return true;
+}
+
+// Clock sweep over the resident blocks in id order, resuming where the last sweep
+// stopped. A block accessed since it was last passed loses its bit and is skipped;
+// one that wasn't is written to the spill file. Runs until bytes of memory are freed
+// or two rounds are done. Blocks waiting for the GC aren't worth the write. Returns
+// whether anything was spilled. Must be called with the mutex held.
+bool MemoryManager::evict_locked(size_t bytes, const std::vector<int>& keep) {
+    std::vector<int> candidates;
+    for (const auto& [id, block] : allocations) {
+        if (!block.spilled && block.size > 0 && block.ref_count->load() > 0 &&
+            std::find(keep.begin(), keep.end(), id) == keep.end()) {
+            candidates.push_back(id);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+    std::sort(candidates.begin(), candidates.end());
+    size_t start = std::lower_bound(candidates.begin(), candidates.end(), clock_hand) - candidates.begin();
+
+    // Writers in the shared chunk must not change a block while it is copied out
+    if (shared_chunk) {
+        shared_chunk->begin_move();
+    }
+    size_t freed = 0;
+    size_t spilled = 0;
+    for (size_t step = 0; step < 2 * candidates.size() && freed < bytes; ++step) {
+        int id = candidates[(start + step) % candidates.size()];
+        MemoryBlock& block = allocations.at(id);
+        if (block.spilled) {
+            continue; // Spilled in the first round
+        }
+        clock_hand = id + 1;
+        if (block.referenced) {
+            block.referenced = false;
+            continue;
+        }
+
+        size_t offset;
+        if (!spill_file->write(block.address, block.size, offset)) {
+            break;
+        }
+        // A heap block's bytes become a hole for the compaction that follows
+        if (block.large) {
+            freed += large_objects->mapped_size(block.size);
+            large_objects->release(block.address);
+        } else {
+            freed += block.size;
+        }
+        block.address = nullptr;
+        block.spilled = true;
+        block.spill_offset = offset;
+        ++spilled;
+    }
+    if (shared_chunk) {
+        shared_chunk->end_move();
+    }
+
+    if (spilled > 0) {
+        std::cout << "Spilled " << spilled << " cold blocks (" << freed << " bytes) to disk" << std::endl;
+    }
+    return spilled > 0;
+}
+
+// Marks a block as used and reads it back in if it was spilled, spilling others to
+// make room if needed. The block and those in keep are never spilled for it. False
+// when it can't be brought back. Must be called with the mutex held.
+bool MemoryManager::touch_locked(int id, MemoryBlock& block, std::vector<int> keep) {
+    block.referenced = true;
+    if (!block.spilled) {
+        return true;
+    }
+
+    keep.push_back(id);
+    size_t alignment = block_alignment(block);
+    size_t large_bytes = block.large ? large_objects->mapped_size(block.size) : 0;
+    bool fits = block.large ? has_room_locked(memory_offset, large_bytes)
+                            : has_room_locked(align_offset(memory_offset, alignment) + block.size, 0);
+    if (!fits && !make_room_locked(block.large ? 0 : block.size + alignment - 1, large_bytes, keep)) {
+        std::cerr << "No room to load spilled ID " << id << std::endl;
+        return false;
+    }
+
+    size_t block_offset = align_offset(memory_offset, alignment);
+    void* address = block.large ? large_objects->allocate(block.size) : static_cast<char*>(memory_chunk) + block_offset;
+    if (address == nullptr || !spill_file->read(block.spill_offset, address, block.size)) {
+        if (address != nullptr && block.large) {
+            large_objects->release(address);
+        }
+        std::cerr << "Failed to load spilled ID " << id << std::endl;
+        return false;
+    }
+
+    spill_file->release(block.spill_offset, block.size);
+    block.address = address;
+    block.spilled = false;
+    if (!block.large) {
+        memory_offset = block_offset + block.size;
+    }
+    return true;
+}
+
+bool MemoryManager::locate(int id, BlockLocation& location) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(id);
+    // Large blocks are outside the shared chunk, so their readers go through the RPCs
+    if (it == allocations.end() || !shared_chunk || it->second.large || !touch_locked(id, it->second)) {
+        return false;
+    }
+
+    const MemoryBlock& block = it->second;
+    location.offset = static_cast<uint64_t>(static_cast<char*>(block.address) - static_cast<char*>(memory_chunk));
+    location.size = block.size;
+    location.type = block.type;
+    // Addresses only change under this lock, so the offset is valid for this sequence
+    location.sequence = shared_chunk->sequence();
+    return true;
+}
+
+std::string MemoryManager::get_shared_memory_name() const {
+    return shared_chunk ? shared_chunk->get_name() : "";
 }
 
 void MemoryManager::log_memory_state() {
+    std::lock_guard<std::mutex> lock(mutex);
+    log_memory_state_locked();
+}
+
+void MemoryManager::log_memory_state_locked() {
+    if (scheduler != nullptr) {
+        schedule_dump_locked(true);
+        return;
+    }
+    dumps.create_detailed_dump_file(format_memory_state_locked());
+}
+
+std::string MemoryManager::format_memory_state_locked() const {
     std::ostringstream oss;
     for (const auto& [block_id, mem_block] : allocations) {
+        std::ostringstream references;
+        for (size_t slot = 0; slot < mem_block.references.size(); ++slot) {
+            references << (slot > 0 ? ", " : "") << mem_block.references[slot];
+        }
         oss << "{\n"
             << "  \"id\": " << block_id << ",\n"
             << "  \"size\": " << mem_block.size << ",\n"
             << "  \"type\": \"" << mem_block.type << "\",\n"
-            << "  \"refCount\": " << mem_block.ref_count << ",\n"
+            << "  \"count\": " << mem_block.count << ",\n"
+            << "  \"refCount\": " << mem_block.ref_count->load() << ",\n"
             << "  \"ptr\": \"" << reinterpret_cast<uintptr_t>(mem_block.address) << "\",\n"
-            << "  \"status\": \"" << (mem_block.ref_count > 0 ? "allocated" : "freed") << "\"\n"
+            << "  \"spilled\": " << (mem_block.spilled ? "true" : "false") << ",\n"
+            << "  \"references\": [" << references.str() << "],\n"
+            << "  \"status\": \"" << (mem_block.ref_count->load() > 0 ? "allocated" : "freed") << "\"\n"
             << "}\n";
     }
+    return oss.str();
+}
+
+// Records a client-defined type. Its name can't shadow a builtin type, and a name
+// that is already registered keeps its first layout.
+bool MemoryManager::register_type(const std::string& name, size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return register_type_locked(name, size, alignment);
+}
+
+// Must be called with the mutex held
+bool MemoryManager::register_type_locked(const std::string& name, size_t size, size_t alignment) {
+    if (name.empty() || type_sizes.count(name) > 0) {
+        std::cerr << "RegisterType failed: invalid name " << name << std::endl;
+        return false;
+    }
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > ARRAY_ALIGNMENT) {
+        std::cerr << "RegisterType failed: invalid layout for " << name << " (size " << size
+                  << ", alignment " << alignment << ")" << std::endl;
+        return false;
+    }
+
+    auto [it, inserted] = registered_types.emplace(name, RegisteredType{size, alignment});
+    if (!inserted) {
+        bool same = it->second.size == size && it->second.alignment == alignment;
+        if (!same) {
+            std::cerr << "RegisterType failed: " << name << " is already registered with size "
+                      << it->second.size << ", alignment " << it->second.alignment << std::endl;
+        }
+        return same;
+    }
+
+    std::cout << "Registered type " << name << " (size " << size << ", alignment " << alignment << ")" << std::endl;
+    if (replication_log != nullptr) {
+        replication_log->log_register_type(name, size, alignment);
+    }
+    return true;
+}
+
+// Builtin types are parsed from text; registered types travel as their raw bytes.
+// Must be called with the mutex held.
+bool MemoryManager::encode_value_locked(const MemoryBlock& block, const std::string& value, void* output) const {
+    if (registered_types.count(block.type) == 0) {
+        return convert_and_validate(block.type, value, output, block.size);
+    }
+    if (value.size() != block.size) {
+        std::cerr << "Conversion failed: " << value.size() << " bytes for a " << block.size
+                  << " byte " << block.type << std::endl;
+        return false;
+    }
+    std::memcpy(output, value.data(), block.size);
+    return true;
+}
+
+std::string MemoryManager::decode_value_locked(const MemoryBlock& block, const void* address) const {
+    if (registered_types.count(block.type) == 0) {
+        return retrieve_value_as_string(block.type, address, block.size);
+    }
+    return std::string(static_cast<const char*>(address), block.size);
+}
+
+// Checks that size bytes can hold count elements of type and sets the alignment of
+// its elements. Blocks are never empty, so every element has at least one byte.
+// Must be called with the mutex held.
+bool MemoryManager::check_layout_locked(int size, const std::string& type, size_t count, size_t& alignment) const {
+    alignment = 1;
+    if (size <= 0) {
+        std::cerr << "Invalid size " << size << " for type " << type << std::endl;
+        return false;
+    }
 
-    // Pass the formatted string to the Dumps class
-    dumps.create_detailed_dump_file(oss.str());
+    // Registered types must be created with their own layout
+    auto registered = registered_types.find(type);
+    if (registered != registered_types.end()) {
+        if (registered->second.size * count != static_cast<size_t>(size)) {
+            std::cerr << "Invalid size " << size << " for " << count << " " << type << std::endl;
+            return false;
+        }
+        alignment = registered->second.alignment;
+    } else if (count > 1) {
+        // An array block holds count elements of a known scalar type, nothing else
+        auto element = type_sizes.find(type);
+        if (element == type_sizes.end() || element->second * count != static_cast<size_t>(size)) {
+            std::cerr << "Invalid array of " << count << " " << type << " in " << size << " bytes" << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
-int MemoryManager::create(int size, const std::string& type) {
-    // Check if there is enough memory
-    if (memory_offset + static_cast<size_t>(size) > memory_chunk_size) {
+int MemoryManager::create(int size, const std::string& type, size_t count, const std::string& session_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t alignment;
+    if (!check_layout_locked(size, type, count, alignment) ||
+        !check_session_locked(session_id, static_cast<size_t>(size))) {
+        return -1;
+    }
+
+    // Check if there is enough memory, compacting and spilling cold blocks if needed
+    size_t block_align = count > 1 ? ARRAY_ALIGNMENT : alignment;
+    size_t block_offset = align_offset(memory_offset, block_align);
+    bool large = large_objects->holds(size);
+    size_t large_bytes = large ? large_objects->mapped_size(size) : 0;
+    bool fits = large ? has_room_locked(memory_offset, large_bytes)
+                      : has_room_locked(block_offset + static_cast<size_t>(size), 0);
+    if (!fits) {
+        fits = make_room_locked(large ? 0 : static_cast<size_t>(size) + block_align - 1, large_bytes, {});
+    }
+    if (!fits) {
         std::cerr << "Not enough memory to allocate " << size << " bytes" << std::endl;
         return -1;
     }
 
-    // Allocate memory
-    void* block_address = static_cast<char*>(memory_chunk) + memory_offset;
+    int id = place_block_locked(size, type, count, alignment, session_id);
+    if (id == -1) {
+        return -1;
+    }
+    std::cout << "Allocated " << size << " bytes for type " << type << " with ID " << id << std::endl;
+
+    // Update the base chunk file
+    update_dumps_locked();
+
+    // Log the memory state
+    log_memory_state_locked();
+
+    return id; // Return the unique ID
+}
+
+// Creates blocks identical blocks back to back at the end of the used memory, so
+// objects built from them end up adjacent. All or nothing: returns no ids when
+// they don't all fit, or when more than MAX_RESERVE_BLOCKS are asked for.
+std::vector<int> MemoryManager::reserve(int size, const std::string& type, size_t blocks,
+                                        const std::string& session_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (blocks == 0 || blocks > MAX_RESERVE_BLOCKS) {
+        std::cerr << "Invalid reservation of " << blocks << " blocks, at most " << MAX_RESERVE_BLOCKS
+                  << " per call" << std::endl;
+        return {};
+    }
+    size_t alignment;
+    if (!check_layout_locked(size, type, 1, alignment) ||
+        !check_session_locked(session_id, blocks * static_cast<size_t>(size))) {
+        return {};
+    }
+
+    // Large blocks get a mapping each, so only small ones end up adjacent
+    bool large = large_objects->holds(size);
+    size_t end_offset = memory_offset;
+    for (size_t i = 0; i < blocks && !large; ++i) {
+        end_offset = align_offset(end_offset, alignment) + static_cast<size_t>(size);
+    }
+    size_t large_bytes = large ? blocks * large_objects->mapped_size(size) : 0;
+    if (!has_room_locked(end_offset, large_bytes) &&
+        !make_room_locked(large ? 0 : blocks * (static_cast<size_t>(size) + alignment - 1), large_bytes, {})) {
+        std::cerr << "Not enough memory to reserve " << blocks << " blocks of " << size << " bytes" << std::endl;
+        return {};
+    }
+
+    std::vector<int> ids;
+    ids.reserve(blocks);
+    for (size_t i = 0; i < blocks; ++i) {
+        int id = place_block_locked(size, type, 1, alignment, session_id);
+        if (id == -1) {
+            // Only a large block's mapping can fail; undo the ones already made
+            for (int placed : ids) {
+                deallocate_locked(placed);
+            }
+            return {};
+        }
+        ids.push_back(id);
+    }
+    std::cout << "Reserved " << blocks << " blocks of " << size << " bytes for type " << type
+              << " with IDs " << ids.front() << " to " << ids.back() << std::endl;
+
+    // One dump for the whole reservation
+    update_dumps_locked();
+    log_memory_state_locked();
+
+    return ids;
+}
+
+// Appends a block after the used memory, or maps it in the large-object space when it
+// is over the threshold; the caller has checked that it fits. Returns -1 when a large
+// block can't be mapped. The block joins session_id, if given, which the caller has
+// checked. Must be called with the mutex held.
+int MemoryManager::place_block_locked(int size, const std::string& type, size_t count, size_t alignment,
+                                      const std::string& session_id) {
+    size_t block_offset = align_offset(memory_offset, count > 1 ? ARRAY_ALIGNMENT : alignment);
+    bool large = large_objects->holds(size);
+
+    // Allocate memory. Mappings are page aligned, which covers every block alignment.
+    void* block_address = large ? large_objects->allocate(size) : static_cast<char*>(memory_chunk) + block_offset;
+    if (block_address == nullptr) {
+        return -1;
+    }
 
     // Create a new memory block
+    int id = next_id++;
+    RefCount* ref_count = ref_counts.at(id);
+    ref_count->reset(1);
     MemoryBlock block = {
         .address = block_address,
         .size = static_cast<size_t>(size),
         .type = type,
-        .ref_count = 1
+        .ref_count = ref_count,
+        .references = {},
+        .count = std::max<size_t>(count, 1),
+        .alignment = alignment,
+        .large = large,
+        .session = session_id
     };
 
     // Store the block in the allocations map
-    int id = next_id++;
     allocations[id] = block;
+    if (!session_id.empty()) {
+        Session& session = sessions.at(session_id);
+        session.used += block.size;
+        session.blocks.insert(id);
+        session.creator_held.insert(id);
+    }
 
     // Update the memory offset
-    memory_offset += static_cast<size_t>(size);
-
-    std::cout << "Allocated " << size << " bytes for type " << type << " with ID " << id << std::endl;
-
-    // Update the base chunk file
-    update_dumps();
+    if (!large) {
+        memory_offset = block_offset + static_cast<size_t>(size);
+    }
 
-    // Log the memory state
-    log_memory_state();
+    if (replication_log != nullptr) {
+        replication_log->log_create(id, block.size, type, block.count, block.alignment);
+    }
 
-    return id; // Return the unique ID
+    return id;
 }
 
 
-bool MemoryManager::set(int id, const std::string& value) {
+bool MemoryManager::set(int id, const std::string& value, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
     auto it = allocations.find(id);
     if (it == allocations.end()) {
         std::cerr << "Set failed: ID " << id << " not found." << std::endl;
@@ -117,103 +625,1328 @@ bool MemoryManager::set(int id, const std::string& value) {
     }
 
     MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "Set failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
 
     // Validate and convert the value
-    if (!convert_and_validate(block.type, value, block.address, block.size)) {
+    if (!encode_value_locked(block, value, block.address)) {
         std::cerr << "Set failed: Conversion or validation failed for ID " << id << "." << std::endl;
         return false;
     }
 
     std::cout << "Set successful for ID " << id << ": " << value << std::endl;
+    publish_write_locked(id, block, origin_client_id);
+
+    return true;
+}
+
+// Tells standbys and caching clients about a new value. Standbys get the converted
+// bytes, so they never parse the value themselves; other clients caching the block
+// must drop their copy. length 0 means the whole block. Must be called with the mutex held.
+void MemoryManager::publish_write_locked(int id, const MemoryBlock& block, const std::string& origin_client_id,
+                                         size_t offset, size_t length) {
+    if (replication_log != nullptr) {
+        replication_log->log_set(id, static_cast<const char*>(block.address) + offset,
+                                 length == 0 ? block.size - offset : length, offset);
+    }
+    if (invalidation_hub != nullptr) {
+        invalidation_hub->publish(id, origin_client_id);
+    }
+}
+
+// The atomic operations run entirely under the mutex, so no other request can
+// observe or change the block between the read and the write.
+bool MemoryManager::fetch_add(int id, const std::string& delta, std::string& previous, std::string& current,
+                              const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+        std::cerr << "FetchAdd failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "FetchAdd failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    previous = decode_value_locked(block, block.address);
+    if (!add_value(block.type, delta, block.address, block.size)) {
+        std::cerr << "FetchAdd failed: can't add " << delta << " to ID " << id << "." << std::endl;
+        return false;
+    }
+    current = decode_value_locked(block, block.address);
+
+    std::cout << "FetchAdd successful for ID " << id << ": " << previous << " -> " << current << std::endl;
+    publish_write_locked(id, block, origin_client_id);
 
     return true;
 }
 
+bool MemoryManager::compare_and_swap(int id, const std::string& expected, const std::string& desired, bool& exchanged,
+                                     std::string& previous, std::string& current, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    exchanged = false;
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+        std::cerr << "CompareAndSwap failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "CompareAndSwap failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    // Both values are converted before anything is compared, so a bad desired value
+    // fails the call instead of only failing when the comparison matches
+    std::vector<char> expected_bytes(block.size, 0);
+    std::vector<char> desired_bytes(block.size, 0);
+    if (!encode_value_locked(block, expected, expected_bytes.data()) ||
+        !encode_value_locked(block, desired, desired_bytes.data())) {
+        std::cerr << "CompareAndSwap failed: Conversion or validation failed for ID " << id << "." << std::endl;
+        return false;
+    }
+
+    previous = decode_value_locked(block, block.address);
+    if (std::memcmp(block.address, expected_bytes.data(), block.size) == 0) {
+        std::memcpy(block.address, desired_bytes.data(), block.size);
+        exchanged = true;
+        publish_write_locked(id, block, origin_client_id);
+    }
+    current = decode_value_locked(block, block.address);
+
+    std::cout << "CompareAndSwap for ID " << id << (exchanged ? " stored " : " kept ") << current << std::endl;
+    return true;
+}
+
+bool MemoryManager::exchange(int id, const std::string& value, std::string& previous, std::string& current,
+                             const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+        std::cerr << "Exchange failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "Exchange failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    std::vector<char> new_bytes(block.size, 0);
+    if (!encode_value_locked(block, value, new_bytes.data())) {
+        std::cerr << "Exchange failed: Conversion or validation failed for ID " << id << "." << std::endl;
+        return false;
+    }
+
+    previous = decode_value_locked(block, block.address);
+    std::memcpy(block.address, new_bytes.data(), block.size);
+    current = decode_value_locked(block, block.address);
+
+    std::cout << "Exchange successful for ID " << id << ": " << previous << " -> " << current << std::endl;
+    publish_write_locked(id, block, origin_client_id);
+
+    return true;
+}
+
+std::vector<TraversedBlock> MemoryManager::traverse(int head_id, int slot, int limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<TraversedBlock> path;
+    std::unordered_set<int> visited;
+    int id = head_id;
+    while (id != -1 && (limit <= 0 || path.size() < static_cast<size_t>(limit))) {
+        auto it = allocations.find(id);
+        // Stop at a dangling id or when a circular structure comes back around
+        if (it == allocations.end() || !visited.insert(id).second) {
+            break;
+        }
+
+        MemoryBlock& block = it->second;
+        if (!touch_locked(id, block)) {
+            break;
+        }
+        int next_id = static_cast<size_t>(slot) < block.references.size() ? block.references[slot] : -1;
+        std::string value = block.ref_count->load() == 0
+            ? "No value assigned to ID " + std::to_string(id) + ". Type: " + block.type
+            : decode_value_locked(block, block.address);
+        path.push_back({id, value, next_id});
+        id = next_id;
+    }
+
+    std::cout << "Traversed " << path.size() << " blocks from ID " << head_id << std::endl;
+    return path;
+}
+
 std::string MemoryManager::get(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
     auto it = allocations.find(id);
     if (it == allocations.end()) {
         return "Error: ID " + std::to_string(id) + " does not exist.";
     }
 
-    const MemoryBlock& block = it->second;
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        return "Error: ID " + std::to_string(id) + " couldn't be loaded.";
+    }
 
     // Check if the block has a value set
-    if (block.ref_count == 0) { // Assuming ref_count == 0 means no value is set
+    if (block.ref_count->load() == 0) { // Assuming ref_count == 0 means no value is set
         return "No value assigned to ID " + std::to_string(id) + ". Type: " + block.type;
     }
 
     // Retrieve the value using the utility function
-    return retrieve_value_as_string(block.type, block.address, block.size);
+    return decode_value_locked(block, block.address);
 }
 
-int MemoryManager::increaseRefCount(int id) {
+// Copies raw elements [first, first + count) of a block into data. count 0 reads to the end.
+// At most MAX_RANGE_BYTES are copied, but always at least one element.
+bool MemoryManager::get_range(int id, size_t first, size_t count, std::string& data, std::string& type,
+                              size_t& total_count) {
+    std::lock_guard<std::mutex> lock(mutex);
     auto it = allocations.find(id);
     if (it == allocations.end()) {
-        std::cerr << "IncreaseRefCount failed: ID " << id << " not found." << std::endl;
-        return -1;
+        std::cerr << "GetRange failed: ID " << id << " not found." << std::endl;
+        return false;
     }
 
     MemoryBlock& block = it->second;
-    block.ref_count++;
-    std::cout << "Increased reference count for ID " << id << " to " << block.ref_count << std::endl;
-
-    // Log the memory state
-    log_memory_state();
+    if (!touch_locked(id, block)) {
+        std::cerr << "GetRange failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    size_t element_size = block.size / block.count;
+    if (first > block.count) {
+        std::cerr << "GetRange failed: element " << first << " out of range for ID " << id << "." << std::endl;
+        return false;
+    }
+    if (count == 0 || count > block.count - first) {
+        count = block.count - first;
+    }
+    count = std::min(count, std::max<size_t>(MAX_RANGE_BYTES / element_size, 1));
 
-    return block.ref_count;
+    data.assign(static_cast<const char*>(block.address) + first * element_size, count * element_size);
+    type = block.type;
+    total_count = block.count;
+    return true;
 }
 
-int MemoryManager::decreaseRefCount(int id) {
+// Overwrites elements starting at first with the raw bytes in data
+bool MemoryManager::set_range(int id, size_t first, const std::string& data, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
     auto it = allocations.find(id);
     if (it == allocations.end()) {
-        std::cerr << "DecreaseRefCount failed: ID " << id << " not found." << std::endl;
-        return -1;
+        std::cerr << "SetRange failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "SetRange failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    size_t element_size = block.size / block.count;
+    if (data.size() % element_size != 0 || first > block.count ||
+        data.size() / element_size > block.count - first) {
+        std::cerr << "SetRange failed: " << data.size() << " bytes at element " << first
+                  << " don't fit ID " << id << "." << std::endl;
+        return false;
+    }
+
+    size_t offset = first * element_size;
+    std::memcpy(static_cast<char*>(block.address) + offset, data.data(), data.size());
+    std::cout << "SetRange successful for ID " << id << ": " << data.size() / element_size
+              << " elements from " << first << std::endl;
+
+    publish_write_locked(id, block, origin_client_id, offset, data.size());
+    return true;
+}
+
+// For int and float elements, x > operand exactly when x > the largest T at or below
+// operand, and x < operand exactly when x < the smallest T at or above it. These find
+// that T; they return false when operand is past every T, so the comparison holds for
+// all elements. operand must not be NaN.
+template <typename T>
+static bool threshold_at_or_below(double operand, T& threshold) {
+    if (operand < std::numeric_limits<T>::lowest()) {
+        if constexpr (std::is_integral<T>::value) {
+            return false;
+        }
+        threshold = -std::numeric_limits<T>::infinity();
+    } else if (operand >= std::numeric_limits<T>::max()) {
+        threshold = std::numeric_limits<T>::max();
+    } else if constexpr (std::is_integral<T>::value) {
+        threshold = static_cast<T>(std::floor(operand));
+    } else {
+        threshold = static_cast<T>(operand);
+        if (threshold > operand) {
+            threshold = std::nextafter(threshold, -std::numeric_limits<T>::infinity());
+        }
+    }
+    return true;
+}
+
+template <typename T>
+static bool threshold_at_or_above(double operand, T& threshold) {
+    if (operand > std::numeric_limits<T>::max()) {
+        if constexpr (std::is_integral<T>::value) {
+            return false;
+        }
+        threshold = std::numeric_limits<T>::infinity();
+    } else if (operand <= std::numeric_limits<T>::lowest()) {
+        threshold = std::numeric_limits<T>::lowest();
+    } else if constexpr (std::is_integral<T>::value) {
+        threshold = static_cast<T>(std::ceil(operand));
+    } else {
+        threshold = static_cast<T>(operand);
+        if (threshold < operand) {
+            threshold = std::nextafter(threshold, std::numeric_limits<T>::infinity());
+        }
+    }
+    return true;
+}
+
+// Whether operand converts to T as is: in range and, for integers, without a fraction
+template <typename T>
+static bool fits_element(double operand) {
+    if constexpr (std::is_integral<T>::value) {
+        return operand >= std::numeric_limits<T>::lowest() && operand <= std::numeric_limits<T>::max() &&
+               std::trunc(operand) == operand;
+    } else {
+        return !std::isfinite(operand) || std::fabs(operand) <= std::numeric_limits<T>::max();
+    }
+}
+
+// Runs one kernel over count elements and formats its result. Returns false, changing
+// nothing, when an update's operand doesn't fit the element type.
+template <typename T>
+static bool run_kernel(ComputeOp op, T* data, size_t count, double operand, std::string& result) {
+    T threshold;
+    switch (op) {
+        case ComputeOp::Sum:
+            result = std::to_string(kernels::sum(data, count));
+            return true;
+        case ComputeOp::Min:
+            result = std::to_string(kernels::min_value(data, count));
+            return true;
+        case ComputeOp::Max:
+            result = std::to_string(kernels::max_value(data, count));
+            return true;
+        case ComputeOp::CountGreater:
+            if (std::isnan(operand)) {
+                result = "0";
+            } else {
+                result = std::to_string(threshold_at_or_below(operand, threshold)
+                                            ? kernels::count_greater(data, count, threshold) : count);
+            }
+            return true;
+        case ComputeOp::CountLess:
+            if (std::isnan(operand)) {
+                result = "0";
+            } else {
+                result = std::to_string(threshold_at_or_above(operand, threshold)
+                                            ? kernels::count_less(data, count, threshold) : count);
+            }
+            return true;
+        case ComputeOp::AddScalar:
+            if (!fits_element<T>(operand)) {
+                return false;
+            }
+            kernels::add_scalar(data, count, static_cast<T>(operand));
+            result = std::to_string(count);
+            return true;
+        case ComputeOp::Scale:
+            if (!fits_element<T>(operand)) {
+                return false;
+            }
+            kernels::scale(data, count, static_cast<T>(operand));
+            result = std::to_string(count);
+            return true;
+    }
+    return false;
+}
+
+// Elements [first, first + count) of a block, count 0 running to the end. The kernels
+// work in place in the chunk, so nothing but the result is copied.
+bool MemoryManager::compute(int id, ComputeOp op, size_t first, size_t count, double operand, std::string& result,
+                            size_t& elements, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+        std::cerr << "Compute failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+
+    MemoryBlock& block = it->second;
+    if (!touch_locked(id, block)) {
+        std::cerr << "Compute failed: ID " << id << " couldn't be loaded." << std::endl;
+        return false;
+    }
+    kernels::ElementType element = kernels::element_type(block.type);
+    if (element == kernels::ElementType::Unsupported) {
+        std::cerr << "Compute failed: type " << block.type << " of ID " << id << " is not numeric." << std::endl;
+        return false;
+    }
+
+    // A scalar block of a builtin type can have any size; the kernels need whole elements
+    size_t element_size = block.size / block.count;
+    if (element_size != kernels::element_size(element)) {
+        std::cerr << "Compute failed: ID " << id << " holds " << element_size << "-byte elements, not "
+                  << block.type << "." << std::endl;
+        return false;
+    }
+    if (first > block.count) {
+        std::cerr << "Compute failed: element " << first << " out of range for ID " << id << "." << std::endl;
+        return false;
+    }
+    elements = (count == 0 || count > block.count - first) ? block.count - first : count;
+    if (elements == 0 && (op == ComputeOp::Min || op == ComputeOp::Max)) {
+        std::cerr << "Compute failed: empty range for ID " << id << "." << std::endl;
+        return false;
+    }
+
+    char* start = static_cast<char*>(block.address) + first * element_size;
+    bool ran = false;
+    switch (element) {
+        case kernels::ElementType::Int:
+            ran = run_kernel(op, reinterpret_cast<int32_t*>(start), elements, operand, result);
+            break;
+        case kernels::ElementType::Float:
+            ran = run_kernel(op, reinterpret_cast<float*>(start), elements, operand, result);
+            break;
+        case kernels::ElementType::Double:
+            ran = run_kernel(op, reinterpret_cast<double*>(start), elements, operand, result);
+            break;
+        case kernels::ElementType::Unsupported:
+            return false;
+    }
+    if (!ran) {
+        std::cerr << "Compute failed: operand " << operand << " doesn't fit " << block.type << "." << std::endl;
+        return false;
+    }
+
+    if ((op == ComputeOp::AddScalar || op == ComputeOp::Scale) && elements > 0) {
+        publish_write_locked(id, block, origin_client_id, first * element_size, elements * element_size);
+    }
+
+    std::cout << "Compute on ID " << id << " over " << elements << " elements"
+              << (kernels::has_avx2() ? " (AVX2)" : "") << ": " << result << std::endl;
+    return true;
+}
+
+// The ref count calls don't take the manager's lock: the counts live in ref_counts,
+// which is found by id without the allocation map, and change with atomic
+// read-modify-writes. With standbys attached they take the lock after all, so the
+// log records the counts in the order they were reached, and so do calls from a
+// client in a session, which also note whether it still holds its blocks' creator
+// reference (see close_session_locked).
+int MemoryManager::increaseRefCount(int id, const std::string& session_id) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (replication_log != nullptr || !session_id.empty()) {
+        lock.lock();
+    }
+    int new_ref_count = change_ref_count(id, 1);
+    if (new_ref_count == -1) {
+        std::cerr << "IncreaseRefCount failed: ID " << id << " not found." << std::endl;
+    } else {
+        note_session_reference_locked(session_id, id, 1);
+    }
+    return new_ref_count;
+}
+
+// Check and increment in one step: a block whose count reached zero is waiting for the
+// GC and can't be brought back. Ids are never reused, so a live block with the id is
+// the one the weak reference was taken from. Returns -1 otherwise.
+int MemoryManager::tryIncreaseRefCount(int id, const std::string& session_id) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (replication_log != nullptr || !session_id.empty()) {
+        lock.lock();
+    }
+    RefCount* ref_count = ref_counts.find(id);
+    int new_ref_count = ref_count != nullptr ? ref_count->try_increment() : RefCount::FREED;
+    if (new_ref_count == RefCount::FREED) {
+        return -1;
+    }
+    if (replication_log != nullptr) {
+        replication_log->log_ref_count(id, new_ref_count);
+    }
+    note_session_reference_locked(session_id, id, 1);
+    return new_ref_count;
+}
+
+int MemoryManager::decreaseRefCount(int id, const std::string& session_id) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (replication_log != nullptr || !session_id.empty()) {
+        lock.lock();
+    }
+    RefCount* ref_count = ref_counts.find(id);
+    if (ref_count != nullptr && ref_count->load() == 0) {
+        std::cerr << "DecreaseRefCount failed: Reference count for ID " << id << " is already 0." << std::endl;
+        return 0;
+    }
+    int new_ref_count = change_ref_count(id, -1);
+    if (new_ref_count == -1) {
+        std::cerr << "DecreaseRefCount failed: ID " << id << " not found." << std::endl;
+    } else {
+        note_session_reference_locked(session_id, id, -1);
+    }
+    return new_ref_count;
+}
+
+std::vector<int> MemoryManager::updateRefCounts(const std::vector<std::pair<int, int>>& deltas,
+                                                const std::string& session_id) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (replication_log != nullptr || !session_id.empty()) {
+        lock.lock();
+    }
+
+    std::vector<int> new_ref_counts;
+    new_ref_counts.reserve(deltas.size());
+    for (const auto& [id, delta] : deltas) {
+        int new_ref_count = change_ref_count(id, delta);
+        if (new_ref_count != -1) {
+            note_session_reference_locked(session_id, id, delta);
+        }
+        new_ref_counts.push_back(new_ref_count);
+    }
+    return new_ref_counts;
+}
+
+// Applies a signed change; a decrement stops at zero. After a decrement, a block at zero
+// goes to the GC, and one that survives while pointing at other blocks may be part of a
+// cycle. A standby leaves both to its primary. Returns the new count, or -1 when the ID
+// doesn't exist. Needs the mutex only when standbys are attached.
+int MemoryManager::change_ref_count(int id, int delta) {
+    RefCount* ref_count = ref_counts.find(id);
+    if (ref_count == nullptr) {
+        return -1;
+    }
+
+    int previous;
+    int current = ref_count->add(delta, previous);
+    if (current == RefCount::FREED) {
+        return -1;
+    }
+    if (current == previous) {
+        return current;
+    }
+    if (replication_log != nullptr) {
+        replication_log->log_ref_count(id, current);
+    }
+    if (delta < 0 && !standby) {
+        if (current == 0 && garbage_collector != nullptr) {
+            garbage_collector->notify(id);
+        } else if (current > 0 && ref_count->has_references.load(std::memory_order_relaxed) &&
+                   cycle_collector != nullptr) {
+            cycle_collector->notify(id);
+        }
+    }
+    return current;
+}
+
+// Validates every operation against a staged copy of the blocks it writes, then
+// applies them together. Everything runs under the mutex, so no other request sees
+// a partly applied transaction. Returns false, with failed_op and error set, when
+// an operation is invalid or a compare doesn't match; nothing is changed then.
+bool MemoryManager::transact(const std::vector<TransactionOp>& ops, std::vector<std::string>& reads, int& failed_op,
+                             std::string& error, const std::string& origin_client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reads.clear();
+    failed_op = -1;
+
+    std::unordered_map<int, std::vector<char>> staged_values;
+    std::unordered_map<int, std::unordered_map<int, int>> staged_references; // id -> slot -> target
+    auto fail = [&](size_t index, const std::string& reason) {
+        failed_op = static_cast<int>(index);
+        error = reason;
+        reads.clear();
+        std::cerr << "Transaction aborted at op " << index << ": " << reason << std::endl;
+        return false;
+    };
+
+    // Load every spilled block up front, so loading one can't spill another of the transaction
+    std::vector<int> ids;
+    for (const TransactionOp& op : ops) {
+        ids.push_back(op.id);
+    }
+    for (size_t i = 0; i < ops.size(); ++i) {
+        auto it = allocations.find(ops[i].id);
+        if (it != allocations.end() && !touch_locked(ops[i].id, it->second, ids)) {
+            return fail(i, "ID " + std::to_string(ops[i].id) + " couldn't be loaded");
+        }
+    }
+
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const TransactionOp& op = ops[i];
+        auto it = allocations.find(op.id);
+        if (it == allocations.end()) {
+            return fail(i, "ID " + std::to_string(op.id) + " not found");
+        }
+        const MemoryBlock& block = it->second;
+        auto staged = staged_values.find(op.id);
+        const void* current = staged != staged_values.end() ? staged->second.data() : block.address;
+
+        switch (op.kind) {
+            case TransactionOp::Kind::Read:
+                reads.push_back(decode_value_locked(block, current));
+                break;
+
+            case TransactionOp::Kind::Compare: {
+                std::vector<char> expected(block.size, 0);
+                if (!encode_value_locked(block, op.value, expected.data())) {
+                    return fail(i, "Value " + op.value + " doesn't convert to " + block.type);
+                }
+                if (std::memcmp(current, expected.data(), block.size) != 0) {
+                    return fail(i, "Compare failed for ID " + std::to_string(op.id));
+                }
+                break;
+            }
+
+            case TransactionOp::Kind::Set: {
+                std::vector<char> bytes(block.size, 0);
+                if (!encode_value_locked(block, op.value, bytes.data())) {
+                    return fail(i, "Value " + op.value + " doesn't convert to " + block.type);
+                }
+                staged_values[op.id] = std::move(bytes);
+                break;
+            }
+
+            case TransactionOp::Kind::SetReference:
+                if (op.slot < 0 || op.slot >= MAX_REFERENCE_SLOTS) {
+                    return fail(i, "Reference slot " + std::to_string(op.slot) + " out of range");
+                }
+                if (op.target_id != -1) {
+                    auto target = allocations.find(op.target_id);
+                    if (target == allocations.end() || target->second.ref_count->load() == 0) {
+                        return fail(i, "Target ID " + std::to_string(op.target_id) + " not found");
+                    }
+                }
+                staged_references[op.id][op.slot] = op.target_id;
+                break;
+        }
+    }
+
+    // Commit. New targets gain their reference before any old target loses one, so
+    // a block that is only moved between slots never touches zero.
+    for (auto& [id, bytes] : staged_values) {
+        MemoryBlock& block = allocations.at(id);
+        std::memcpy(block.address, bytes.data(), block.size);
+        publish_write_locked(id, block, origin_client_id);
+    }
+
+    std::vector<int> released;
+    for (const auto& [id, slots] : staged_references) {
+        for (const auto& [slot, target_id] : slots) {
+            if (target_id != -1) {
+                // A count that dropped to zero since the check revives; the GC then leaves the block
+                int target_count = allocations.at(target_id).ref_count->add(1);
+                if (replication_log != nullptr) {
+                    replication_log->log_ref_count(target_id, target_count);
+                }
+            }
+        }
+    }
+    for (const auto& [id, slots] : staged_references) {
+        MemoryBlock& block = allocations.at(id);
+        for (const auto& [slot, target_id] : slots) {
+            if (block.references.size() <= static_cast<size_t>(slot)) {
+                block.references.resize(slot + 1, -1);
+                block.ref_count->has_references = true;
+            }
+            if (block.references[slot] != -1) {
+                released.push_back(block.references[slot]);
+            }
+            block.references[slot] = target_id;
+            if (replication_log != nullptr) {
+                replication_log->log_reference(id, slot, target_id);
+            }
+        }
+    }
+    for (int target_id : released) {
+        release_reference(target_id);
+    }
+
+    std::cout << "Transaction committed: " << ops.size() << " operations, " << staged_values.size()
+              << " blocks written" << std::endl;
+
+    // Log the memory state
+    log_memory_state_locked();
+
+    return true;
+}
+
+bool MemoryManager::setReference(int id, int slot, int target_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+        std::cerr << "SetReference failed: ID " << id << " not found." << std::endl;
+        return false;
+    }
+    if (slot < 0 || slot >= MAX_REFERENCE_SLOTS) {
+        std::cerr << "SetReference failed: slot " << slot << " out of range for ID " << id << "." << std::endl;
+        return false;
+    }
+
+    if (target_id != -1) {
+        auto target = allocations.find(target_id);
+        // A block whose count already reached zero is waiting for the GC and can't be revived
+        int target_count = target != allocations.end() ? target->second.ref_count->try_increment() : RefCount::FREED;
+        if (target_count == RefCount::FREED) {
+            std::cerr << "SetReference failed: target ID " << target_id << " not found." << std::endl;
+            return false;
+        }
+        if (replication_log != nullptr) {
+            replication_log->log_ref_count(target_id, target_count);
+        }
+    }
+
+    MemoryBlock& block = it->second;
+    if (block.references.size() <= static_cast<size_t>(slot)) {
+        block.references.resize(slot + 1, -1);
+        block.ref_count->has_references = true;
+    }
+
+    int previous_id = block.references[slot];
+    block.references[slot] = target_id;
+    if (replication_log != nullptr) {
+        replication_log->log_reference(id, slot, target_id);
+    }
+    if (previous_id != -1) {
+        release_reference(previous_id);
+    }
+
+    std::cout << "Reference slot " << slot << " of ID " << id << " now points to " << target_id << std::endl;
+
+    // Log the memory state
+    log_memory_state_locked();
+
+    return true;
+}
+
+// Drops a reference held by another block. Must be called with the mutex held.
+void MemoryManager::release_reference(int target_id) {
+    change_ref_count(target_id, -1);
+}
+
+size_t MemoryManager::collect_cycles(const std::vector<int>& candidates) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<int> garbage = CycleCollector::find_garbage(allocations, candidates);
+    if (garbage.empty()) {
+        return 0;
+    }
+
+    // Increments don't take the lock, so a client may have taken a reference since the
+    // counts were read. Each count must still be just the references from inside the
+    // garbage; freezing holds it there, and increments wait, until the blocks are freed.
+    std::unordered_map<int, int> internal;
+    for (int id : garbage) {
+        internal[id];
+    }
+    for (int id : garbage) {
+        for (int target_id : allocations.at(id).references) {
+            auto target = internal.find(target_id);
+            if (target != internal.end()) {
+                target->second++;
+            }
+        }
+    }
+    std::vector<int> frozen;
+    for (int id : garbage) {
+        if (!allocations.at(id).ref_count->freeze(internal[id])) {
+            for (int frozen_id : frozen) {
+                allocations.at(frozen_id).ref_count->thaw(internal[frozen_id]);
+            }
+            std::cout << "Cycle through ID " << id << " gained a reference, checking again later" << std::endl;
+            for (int candidate : candidates) {
+                cycle_collector->notify(candidate);
+            }
+            return 0;
+        }
+        frozen.push_back(id);
+    }
+
+    // Free the whole cycle first, then drop the references it held to surviving blocks
+    std::vector<int> outgoing;
+    for (int id : garbage) {
+        auto it = allocations.find(id);
+        MemoryBlock& block = it->second;
+        outgoing.insert(outgoing.end(), block.references.begin(), block.references.end());
+        block.ref_count->mark_freed();
+        release_block_memory_locked(block);
+        leave_session_locked(id, block);
+        allocations.erase(it);
+        if (invalidation_hub != nullptr) {
+            invalidation_hub->publish(id);
+        }
+        if (replication_log != nullptr) {
+            replication_log->log_free(id);
+        }
+        std::cout << "Cycle collector freed ID " << id << std::endl;
+    }
+    for (int target_id : outgoing) {
+        if (target_id != -1) {
+            release_reference(target_id);
+        }
+    }
+
+    request_compaction_locked();
+    update_dumps_locked();
+    log_memory_state_locked();
+
+    return garbage.size();
+}
+
+// Copies blocks into frames under the lock, a frame at a time, and writes each one after
+// releasing it, so requests keep running while a big heap streams out. Blocks go out
+// in id order; a block bigger than a frame is copied at once and sent in pieces.
+bool MemoryManager::export_heap(size_t frame_bytes, const std::function<bool(memory_manager::HeapFrame&)>& write) {
+    frame_bytes = std::clamp<size_t>(frame_bytes, 1, MAX_EXPORT_FRAME_BYTES);
+
+    memory_manager::HeapFrame frame;
+    std::vector<int> ids;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [name, layout] : registered_types) {
+            memory_manager::RegisterTypeRequest* type = frame.add_types();
+            type->set_name(name);
+            type->set_size(static_cast<uint32_t>(layout.size));
+            type->set_alignment(static_cast<uint32_t>(layout.alignment));
+        }
+        ids.reserve(allocations.size());
+        for (const auto& [id, block] : allocations) {
+            if (block.ref_count->load() > 0) {
+                ids.push_back(id); // Blocks at zero are waiting for the GC
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    size_t next = 0;
+    size_t blocks = 0;
+    size_t bytes = 0;
+    while (next < ids.size() || frame.types_size() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string* data = frame.mutable_data();
+            while (next < ids.size() && data->size() < frame_bytes) {
+                auto it = allocations.find(ids[next++]);
+                if (it == allocations.end() || it->second.ref_count->load() == 0) {
+                    continue; // Freed since the export started
+                }
+
+                const MemoryBlock& block = it->second;
+                memory_manager::ExportedBlock* exported = frame.add_blocks();
+                exported->set_id(it->first);
+                exported->set_size(static_cast<int>(block.size));
+                exported->set_type(block.type);
+                exported->set_count(static_cast<int>(block.count));
+                exported->set_alignment(static_cast<int>(block.alignment));
+                exported->set_ref_count(block.ref_count->load());
+                for (int target_id : block.references) {
+                    exported->add_references(target_id);
+                }
+
+                // Spilled blocks are read straight from the file, like a replication snapshot does
+                size_t start = data->size();
+                data->resize(start + block.size);
+                if (block.spilled) {
+                    spill_file->read(block.spill_offset, data->data() + start, block.size);
+                } else {
+                    std::memcpy(data->data() + start, block.address, block.size);
+                }
+                ++blocks;
+                bytes += block.size;
+            }
+        }
+        if (frame.blocks_size() == 0 && frame.types_size() == 0) {
+            break; // Everything left was freed
+        }
+
+        if (frame.data().size() <= frame_bytes) {
+            if (!write(frame)) {
+                return false;
+            }
+        } else {
+            std::string data;
+            data.swap(*frame.mutable_data());
+            for (size_t sent = 0; sent < data.size(); sent += frame_bytes) {
+                frame.set_data(data.data() + sent, std::min(frame_bytes, data.size() - sent));
+                if (!write(frame)) {
+                    return false;
+                }
+                frame.Clear();
+            }
+        }
+        frame.Clear();
+    }
+
+    std::cout << "Exported " << blocks << " blocks, " << bytes << " bytes" << std::endl;
+    return true;
+}
+
+// Creates a frame's blocks back to back at the end of the heap, then copies the frame's
+// bytes into them, and into the block left half-filled by the previous frame. References
+// wait for finish_import, when every block they may point at exists.
+bool MemoryManager::import_frame(const memory_manager::HeapFrame& frame, HeapImport& import) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!import.error.empty()) {
+        return false;
+    }
+
+    for (const auto& type : frame.types()) {
+        if (!register_type_locked(type.name(), type.size(), type.alignment())) {
+            import.error = "Type " + type.name() + " clashes with this server's";
+            return false;
+        }
+    }
+
+    // Room for the whole frame first, compacting and spilling as a create would
+    size_t end_offset = memory_offset;
+    size_t heap_bytes = 0;
+    size_t large_bytes = 0;
+    for (const auto& exported : frame.blocks()) {
+        size_t count = static_cast<size_t>(std::max(exported.count(), 1));
+        size_t alignment;
+        if (import.ids.count(exported.id()) > 0 ||
+            !check_layout_locked(exported.size(), exported.type(), count, alignment)) {
+            import.error = "Invalid block " + std::to_string(exported.id());
+            return false;
+        }
+        size_t size = static_cast<size_t>(exported.size());
+        if (large_objects->holds(size)) {
+            large_bytes += large_objects->mapped_size(size);
+        } else {
+            size_t block_align = count > 1 ? ARRAY_ALIGNMENT : alignment;
+            end_offset = align_offset(end_offset, block_align) + size;
+            heap_bytes += size + block_align - 1;
+        }
+    }
+    if (!has_room_locked(end_offset, large_bytes) && !make_room_locked(heap_bytes, large_bytes, {})) {
+        import.error = "Not enough memory for " + std::to_string(frame.blocks_size()) + " more blocks";
+        return false;
+    }
+
+    for (const auto& exported : frame.blocks()) {
+        size_t count = static_cast<size_t>(std::max(exported.count(), 1));
+        size_t alignment;
+        check_layout_locked(exported.size(), exported.type(), count, alignment);
+        int id = place_block_locked(exported.size(), exported.type(), count, alignment);
+        if (id == -1) {
+            import.error = "Failed to allocate block " + std::to_string(exported.id());
+            return false;
+        }
+        import.ids[exported.id()] = id;
+        import.exported_ids.push_back(exported.id());
+        import.blocks.push_back(id);
+
+        // Counts held by the exporting server's clients carry over. Nobody holds them here
+        // until those clients switch to the new ids, which the response maps them to.
+        int ref_count = std::max(exported.ref_count(), 1);
+        allocations.at(id).ref_count->reset(ref_count);
+        if (replication_log != nullptr && ref_count != 1) {
+            replication_log->log_ref_count(id, ref_count);
+        }
+        if (exported.references_size() > 0) {
+            int slots = std::min(exported.references_size(), MAX_REFERENCE_SLOTS);
+            import.references.emplace_back(id, std::vector<int>(exported.references().begin(),
+                                                                exported.references().begin() + slots));
+        }
+    }
+
+    const std::string& data = frame.data();
+    size_t consumed = 0;
+    while (consumed < data.size()) {
+        if (import.filling >= import.blocks.size()) {
+            import.error = "More data than blocks";
+            return false;
+        }
+        int id = import.blocks[import.filling];
+        auto it = allocations.find(id);
+        if (it == allocations.end() || !touch_locked(id, it->second)) {
+            import.error = "Imported block " + std::to_string(id) + " couldn't be loaded";
+            return false;
+        }
+
+        MemoryBlock& block = it->second;
+        size_t length = std::min(block.size - import.filled, data.size() - consumed);
+        std::memcpy(static_cast<char*>(block.address) + import.filled, data.data() + consumed, length);
+        consumed += length;
+        import.filled += length;
+        import.bytes += length;
+        if (import.filled == block.size) {
+            if (replication_log != nullptr) {
+                replication_log->log_set(id, block.address, block.size);
+            }
+            ++import.filling;
+            import.filled = 0;
+        }
+    }
+    return true;
+}
+
+bool MemoryManager::finish_import(HeapImport& import) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (import.error.empty() && import.filling < import.blocks.size()) {
+        import.error = "Stream ended before the data of block " + std::to_string(import.exported_ids[import.filling]);
+    }
+
+    if (!import.error.empty()) {
+        std::cerr << "Import failed: " << import.error << std::endl;
+        for (int id : import.blocks) {
+            deallocate_locked(id);
+        }
+        if (!import.blocks.empty()) {
+            request_compaction_locked();
+            update_dumps_locked();
+        }
+        return false;
+    }
+
+    // Slots pointing at blocks that weren't exported come out empty
+    for (const auto& [id, targets] : import.references) {
+        MemoryBlock& block = allocations.at(id);
+        block.references.assign(targets.size(), -1);
+        block.ref_count->has_references = true;
+        for (size_t slot = 0; slot < targets.size(); ++slot) {
+            auto target = import.ids.find(targets[slot]);
+            if (target == import.ids.end()) {
+                continue;
+            }
+            block.references[slot] = target->second;
+            if (replication_log != nullptr) {
+                replication_log->log_reference(id, static_cast<int>(slot), target->second);
+            }
+        }
+    }
+
+    std::cout << "Imported " << import.blocks.size() << " blocks, " << import.bytes << " bytes" << std::endl;
+    update_dumps_locked();
+    log_memory_state_locked();
+    return true;
+}
+
+// Starts a standby's snapshot: runs install with the RESET and the registered types,
+// still holding the mutex, so a sender can start queueing with no mutation slipping
+// in between. Returns the ids of the blocks to send, in order; blocks created later
+// reach the standby through the log.
+std::vector<int> MemoryManager::replication_snapshot_begin(
+    const std::function<void(std::vector<memory_manager::ReplicationEntry>&)>& install) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<memory_manager::ReplicationEntry> entries;
+    entries.reserve(registered_types.size() + 1);
+
+    memory_manager::ReplicationEntry reset;
+    reset.set_kind(memory_manager::ReplicationEntry::RESET);
+    reset.set_id(next_id);
+    entries.push_back(std::move(reset));
+
+    for (const auto& [name, layout] : registered_types) {
+        memory_manager::ReplicationEntry type;
+        type.set_kind(memory_manager::ReplicationEntry::REGISTER_TYPE);
+        type.set_type(name);
+        type.set_size(static_cast<int>(layout.size));
+        type.set_alignment(static_cast<int>(layout.alignment));
+        entries.push_back(std::move(type));
+    }
+
+    std::vector<int> ids;
+    ids.reserve(allocations.size());
+    for (const auto& [id, block] : allocations) {
+        ids.push_back(id);
+    }
+    install(entries);
+
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// Copies the next blocks of a snapshot, from ids[next] on and about max_bytes of them,
+// and runs install with their entries under the mutex. Entries logged before then were
+// queued ahead and the standby skips those of blocks it doesn't have yet; the ones
+// logged afterwards follow the piece. Blocks freed since the snapshot began are left
+// out. Returns the index to continue from.
+size_t MemoryManager::replication_snapshot_next(
+    const std::vector<int>& ids, size_t next, size_t max_bytes,
+    const std::function<void(std::vector<memory_manager::ReplicationEntry>&)>& install) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<memory_manager::ReplicationEntry> entries;
+    std::vector<memory_manager::ReplicationEntry> references;
+    size_t bytes = 0;
+    for (; next < ids.size() && (bytes == 0 || bytes < max_bytes); ++next) {
+        int id = ids[next];
+        auto it = allocations.find(id);
+        if (it == allocations.end()) {
+            continue;
+        }
+        const MemoryBlock& block = it->second;
+
+        memory_manager::ReplicationEntry create;
+        create.set_kind(memory_manager::ReplicationEntry::CREATE);
+        create.set_id(id);
+        create.set_size(static_cast<int>(block.size));
+        create.set_type(block.type);
+        create.set_count(static_cast<int>(block.count));
+        create.set_alignment(static_cast<int>(block.alignment));
+        entries.push_back(std::move(create));
+
+        memory_manager::ReplicationEntry value;
+        value.set_kind(memory_manager::ReplicationEntry::SET);
+        value.set_id(id);
+        if (block.spilled) {
+            // Read straight from the file, so a snapshot doesn't pull the whole heap back in
+            std::string data(block.size, '\0');
+            spill_file->read(block.spill_offset, data.data(), block.size);
+            value.set_value(std::move(data));
+        } else {
+            value.set_value(static_cast<const char*>(block.address), block.size);
+        }
+        entries.push_back(std::move(value));
+        bytes += block.size;
+
+        memory_manager::ReplicationEntry ref_count;
+        ref_count.set_kind(memory_manager::ReplicationEntry::REF_COUNT);
+        ref_count.set_id(id);
+        ref_count.set_ref_count(block.ref_count->load());
+        entries.push_back(std::move(ref_count));
+
+        // A slot may point at a block of a later piece; the standby keeps it as it is
+        for (size_t slot = 0; slot < block.references.size(); ++slot) {
+            if (block.references[slot] == -1) {
+                continue;
+            }
+            memory_manager::ReplicationEntry reference;
+            reference.set_kind(memory_manager::ReplicationEntry::REFERENCE);
+            reference.set_id(id);
+            reference.set_slot(static_cast<int>(slot));
+            reference.set_target_id(block.references[slot]);
+            references.push_back(std::move(reference));
+        }
+    }
+    for (auto& reference : references) {
+        entries.push_back(std::move(reference));
+    }
+
+    install(entries);
+    return next;
+}
+
+// Standby side. Ids and reference counts come from the primary as they are, so nothing
+// here re-derives them. Returns the sequence of the last applied entry.
+uint64_t MemoryManager::apply_replication(const memory_manager::ReplicationBatch& batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t applied_sequence = 0;
+    bool freed = false;
+    for (const auto& entry : batch.entries()) {
+        auto it = allocations.find(entry.id());
+        switch (entry.kind()) {
+            case memory_manager::ReplicationEntry::RESET:
+                for (const auto& [id, block] : allocations) {
+                    block.ref_count->mark_freed();
+                    if (block.spilled) {
+                        spill_file->release(block.spill_offset, block.size);
+                    }
+                    if (invalidation_hub != nullptr) {
+                        invalidation_hub->publish(id);
+                    }
+                }
+                allocations.clear();
+                large_objects->clear();
+                registered_types.clear();
+                memory_offset = 0;
+                next_id = entry.id();
+                std::cout << "Standby reset, next ID " << next_id << std::endl;
+                break;
+
+            case memory_manager::ReplicationEntry::CREATE: {
+                size_t size = static_cast<size_t>(entry.size());
+                size_t count = static_cast<size_t>(std::max(entry.count(), 1));
+                size_t element_alignment = static_cast<size_t>(std::max(entry.alignment(), 1));
+                size_t alignment = count > 1 ? ARRAY_ALIGNMENT : element_alignment;
+                bool large = large_objects->holds(size);
+                size_t large_bytes = large ? large_objects->mapped_size(size) : 0;
+                // The primary compacts and spills on its own schedule, so make room here first if needed
+                if (!has_room_locked(large ? memory_offset : align_offset(memory_offset, alignment) + size, large_bytes)) {
+                    make_room_locked(large ? 0 : size + alignment - 1, large_bytes, {});
+                }
+                size_t block_offset = align_offset(memory_offset, alignment);
+                void* address = nullptr;
+                if (has_room_locked(large ? memory_offset : block_offset + size, large_bytes)) {
+                    address = large ? large_objects->allocate(size) : static_cast<char*>(memory_chunk) + block_offset;
+                }
+                if (address == nullptr) {
+                    std::cerr << "Replication failed: no room for ID " << entry.id() << std::endl;
+                    break;
+                }
+                RefCount* ref_count = ref_counts.at(entry.id());
+                ref_count->reset(1);
+                MemoryBlock block = {
+                    .address = address,
+                    .size = size,
+                    .type = entry.type(),
+                    .ref_count = ref_count,
+                    .references = {},
+                    .count = count,
+                    .alignment = element_alignment,
+                    .large = large,
+                    .session = {} // Sessions stay on the primary
+                };
+                allocations[entry.id()] = block;
+                if (!large) {
+                    memory_offset = block_offset + size;
+                }
+                next_id = std::max(next_id, entry.id() + 1);
+                break;
+            }
+
+            case memory_manager::ReplicationEntry::SET:
+                if (it != allocations.end() && entry.offset() <= it->second.size && touch_locked(entry.id(), it->second)) {
+                    std::memcpy(static_cast<char*>(it->second.address) + entry.offset(), entry.value().data(),
+                                std::min<size_t>(it->second.size - entry.offset(), entry.value().size()));
+                    if (invalidation_hub != nullptr) {
+                        invalidation_hub->publish(entry.id());
+                    }
+                }
+                break;
+
+            case memory_manager::ReplicationEntry::REF_COUNT:
+                if (it != allocations.end()) {
+                    it->second.ref_count->reset(entry.ref_count());
+                }
+                break;
+
+            case memory_manager::ReplicationEntry::REFERENCE:
+                if (it != allocations.end() && entry.slot() >= 0 && entry.slot() < MAX_REFERENCE_SLOTS) {
+                    std::vector<int>& references = it->second.references;
+                    if (references.size() <= static_cast<size_t>(entry.slot())) {
+                        references.resize(entry.slot() + 1, -1);
+                        it->second.ref_count->has_references = true;
+                    }
+                    references[entry.slot()] = entry.target_id();
+                }
+                break;
+
+            case memory_manager::ReplicationEntry::REGISTER_TYPE:
+                registered_types[entry.type()] = {static_cast<size_t>(entry.size()), static_cast<size_t>(entry.alignment())};
+                break;
+
+            case memory_manager::ReplicationEntry::FREE:
+                // Counts of the blocks it pointed at follow as REF_COUNT entries. A block
+                // freed before its snapshot piece was taken never got here.
+                if (it != allocations.end()) {
+                    deallocate_locked(entry.id());
+                    freed = true;
+                }
+                break;
+
+            default:
+                std::cerr << "Replication: unknown entry kind " << entry.kind() << std::endl;
+                break;
+        }
+        if (entry.sequence() != 0) {
+            applied_sequence = entry.sequence();
+        }
     }
 
-    MemoryBlock& block = it->second;
-    if (block.ref_count > 0) {
-        block.ref_count--;
-        std::cout << "Decreased reference count for ID " << id << " to " << block.ref_count << std::endl;
-            // If refcount == zero, notify garbage collector
-            if (block.ref_count == 0 && garbage_collector != nullptr) {
-                garbage_collector->notify(id);
-            }
-    } else {
-            
-        std::cerr << "DecreaseRefCount failed: Reference count for ID " << id << " is already 0." << std::endl;
+    if (freed) {
+        request_compaction_locked();
     }
+    update_dumps_locked();
 
-    // Log the memory state
-    log_memory_state();
+    return applied_sequence;
+}
+
+// Every mutating handler asks first, the lock-free ref count ones included, so this
+// doesn't take the lock
+bool MemoryManager::is_standby() const {
+    return standby.load(std::memory_order_acquire);
+}
 
-    return block.ref_count;
+// Makes this standby a primary. Blocks the old primary had queued for its GC are handed to ours.
+bool MemoryManager::promote() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!standby) {
+        return false;
+    }
+    standby = false;
+    for (const auto& [id, block] : allocations) {
+        if (block.ref_count->load() == 0 && garbage_collector != nullptr) {
+            garbage_collector->notify(id);
+        }
+    }
+    std::cout << "Promoted to primary with " << allocations.size() << " blocks" << std::endl;
+    return true;
 }
 
 class MemoryManagerServiceImpl final : public memory_manager::MemoryManager::Service {
 private:
     MemoryManager* memory_manager;
+    InvalidationHub* invalidation_hub;
+    BackgroundScheduler* scheduler; // Told how many requests are in flight
+
+    // Mutations on a standby come only from its primary
+    static grpc::Status standby_status() {
+        return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "This server is a standby; send writes to the primary");
+    }
 
 public:
-    explicit MemoryManagerServiceImpl(MemoryManager* mem_mgr) : memory_manager(mem_mgr) {}
+    MemoryManagerServiceImpl(MemoryManager* mem_mgr, InvalidationHub* hub, BackgroundScheduler* background_scheduler)
+        : memory_manager(mem_mgr), invalidation_hub(hub), scheduler(background_scheduler) {}
 
     grpc::Status Create(::grpc::ServerContext* context, const memory_manager::CreateRequest* request,
                         memory_manager::CreateResponse* response) override {
-        int id = memory_manager->create(request->size(), request->type());
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        int id = memory_manager->create(request->size(), request->type(), std::max(request->count(), 1),
+                                        request->session_id());
         if (id == -1) {
             response->set_id(id);
             response->set_success(false); // Mark the operation as failed
-            response->set_message("Create operation failed. Invalid type or insufficient memory.");
+            response->set_message("Create operation failed. Invalid type, insufficient memory or session quota exceeded.");
         } else {
             response->set_id(id);
             response->set_success(true); // Mark the operation as successful
             response->set_message("Create operation successful.");
         }
+        response->set_free_memory(memory_manager->get_free_memory());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Reserve(::grpc::ServerContext* context, const memory_manager::ReserveRequest* request,
+                         memory_manager::ReserveResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::vector<int> ids = memory_manager->reserve(request->size(), request->type(),
+                                                       static_cast<size_t>(std::max(request->blocks(), 0)),
+                                                       request->session_id());
+        for (int id : ids) {
+            response->add_ids(id);
+        }
+        response->set_success(!ids.empty());
+        response->set_message(ids.empty() ? "Reserve operation failed. Invalid type or block count, insufficient memory or session quota exceeded."
+                                          : "Reserve operation successful. " + std::to_string(ids.size()) + " blocks reserved.");
+        response->set_free_memory(memory_manager->get_free_memory());
         return grpc::Status::OK;
     }
 
     grpc::Status Set(::grpc::ServerContext* context, const memory_manager::SetRequest* request,
                      memory_manager::SetResponse* response) override {
-        bool success = memory_manager->set(request->id(), request->value());
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        bool success = memory_manager->set(request->id(), request->value(), request->client_id());
         response->set_success(success);
         response->set_message(success ? "Set operation successful for ID: " + std::to_string(request->id())
                                        : "Set operation failed for ID: " + std::to_string(request->id()));
@@ -222,6 +1955,7 @@ public:
 
     grpc::Status Get(::grpc::ServerContext* context, const memory_manager::GetRequest* request,
                      memory_manager::GetResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
         std::string value = memory_manager->get(request->id());
         response->set_value(value);
         response->set_success(true);
@@ -229,35 +1963,464 @@ public:
         return grpc::Status::OK;
     }
 
+    grpc::Status FetchAdd(::grpc::ServerContext* context, const memory_manager::FetchAddRequest* request,
+                          memory_manager::AtomicResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::string previous, current;
+        bool success = memory_manager->fetch_add(request->id(), request->delta(), previous, current, request->client_id());
+        response->set_success(success);
+        response->set_previous(previous);
+        response->set_current(current);
+        response->set_message(success ? "FetchAdd operation successful for ID: " + std::to_string(request->id())
+                                       : "FetchAdd operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status CompareAndSwap(::grpc::ServerContext* context, const memory_manager::CompareAndSwapRequest* request,
+                                memory_manager::AtomicResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::string previous, current;
+        bool exchanged = false;
+        bool success = memory_manager->compare_and_swap(request->id(), request->expected(), request->desired(),
+                                                        exchanged, previous, current, request->client_id());
+        response->set_success(success);
+        response->set_exchanged(exchanged);
+        response->set_previous(previous);
+        response->set_current(current);
+        response->set_message(success ? "CompareAndSwap operation successful for ID: " + std::to_string(request->id())
+                                       : "CompareAndSwap operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Exchange(::grpc::ServerContext* context, const memory_manager::ExchangeRequest* request,
+                          memory_manager::AtomicResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::string previous, current;
+        bool success = memory_manager->exchange(request->id(), request->value(), previous, current, request->client_id());
+        response->set_success(success);
+        response->set_previous(previous);
+        response->set_current(current);
+        response->set_message(success ? "Exchange operation successful for ID: " + std::to_string(request->id())
+                                       : "Exchange operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetRange(::grpc::ServerContext* context, const memory_manager::GetRangeRequest* request,
+                          memory_manager::GetRangeResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        std::string type;
+        size_t total_count = 0;
+        // The elements are copied once, from the chunk straight into the response
+        bool success = memory_manager->get_range(request->id(), request->first(), request->count(),
+                                                 *response->mutable_data(), type, total_count);
+        response->set_success(success);
+        response->set_type(type);
+        response->set_total_count(static_cast<uint32_t>(total_count));
+        response->set_message(success ? "GetRange operation successful for ID: " + std::to_string(request->id())
+                                       : "GetRange operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status SetRange(::grpc::ServerContext* context, const memory_manager::SetRangeRequest* request,
+                          memory_manager::SetRangeResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        bool success = memory_manager->set_range(request->id(), request->first(), request->data(), request->client_id());
+        response->set_success(success);
+        response->set_message(success ? "SetRange operation successful for ID: " + std::to_string(request->id())
+                                       : "SetRange operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status RegisterType(::grpc::ServerContext* context, const memory_manager::RegisterTypeRequest* request,
+                              memory_manager::RegisterTypeResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        bool success = memory_manager->register_type(request->name(), request->size(), request->alignment());
+        response->set_success(success);
+        response->set_message(success ? "RegisterType operation successful for " + request->name()
+                                       : "RegisterType operation failed for " + request->name() +
+                                         ". The name is taken or the layout is invalid.");
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Compute(::grpc::ServerContext* context, const memory_manager::ComputeRequest* request,
+                         memory_manager::ComputeResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        ComputeOp op;
+        switch (request->op()) {
+            case memory_manager::ComputeRequest::SUM: op = ComputeOp::Sum; break;
+            case memory_manager::ComputeRequest::MIN: op = ComputeOp::Min; break;
+            case memory_manager::ComputeRequest::MAX: op = ComputeOp::Max; break;
+            case memory_manager::ComputeRequest::COUNT_GREATER: op = ComputeOp::CountGreater; break;
+            case memory_manager::ComputeRequest::COUNT_LESS: op = ComputeOp::CountLess; break;
+            case memory_manager::ComputeRequest::ADD_SCALAR: op = ComputeOp::AddScalar; break;
+            case memory_manager::ComputeRequest::SCALE: op = ComputeOp::Scale; break;
+            default:
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown compute operation");
+        }
+        // In-place updates are writes, and a standby only takes those from its primary
+        if ((op == ComputeOp::AddScalar || op == ComputeOp::Scale) && memory_manager->is_standby()) {
+            return standby_status();
+        }
+
+        std::string result;
+        size_t elements = 0;
+        bool success = memory_manager->compute(request->id(), op, request->first(), request->count(),
+                                               request->operand(), result, elements, request->client_id());
+        response->set_success(success);
+        response->set_result(result);
+        response->set_elements(static_cast<uint32_t>(elements));
+        response->set_message(success ? "Compute operation successful for ID: " + std::to_string(request->id())
+                                       : "Compute operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Transact(::grpc::ServerContext* context, const memory_manager::TransactRequest* request,
+                          memory_manager::TransactResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+
+        std::vector<TransactionOp> ops;
+        ops.reserve(request->ops_size());
+        for (const auto& op : request->ops()) {
+            TransactionOp::Kind kind;
+            switch (op.kind()) {
+                case memory_manager::TransactOp::READ: kind = TransactionOp::Kind::Read; break;
+                case memory_manager::TransactOp::COMPARE: kind = TransactionOp::Kind::Compare; break;
+                case memory_manager::TransactOp::SET: kind = TransactionOp::Kind::Set; break;
+                case memory_manager::TransactOp::SET_REFERENCE: kind = TransactionOp::Kind::SetReference; break;
+                default:
+                    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown transaction operation");
+            }
+            ops.push_back({kind, op.id(), op.value(), op.slot(), op.target_id()});
+        }
+
+        std::vector<std::string> reads;
+        int failed_op = -1;
+        std::string error;
+        bool committed = memory_manager->transact(ops, reads, failed_op, error, request->client_id());
+        response->set_success(committed);
+        response->set_failed_op(failed_op);
+        for (const std::string& value : reads) {
+            response->add_values(value);
+        }
+        response->set_message(committed ? "Transaction committed: " + std::to_string(ops.size()) + " operations"
+                                         : "Transaction aborted: " + error);
+        return grpc::Status::OK;
+    }
+
     grpc::Status IncreaseRefCount(::grpc::ServerContext* context, const memory_manager::RefCountRequest* request,
                                   memory_manager::RefCountResponse* response) override {
-        int new_ref_count = memory_manager->increaseRefCount(request->id());
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        int new_ref_count = memory_manager->increaseRefCount(request->id(), request->session_id());
         response->set_new_ref_count(new_ref_count);
         response->set_success(true);
         response->set_message("IncreaseRefCount operation successful. New RefCount: " + std::to_string(new_ref_count));
         return grpc::Status::OK;
     }
 
+    grpc::Status TryIncreaseRefCount(::grpc::ServerContext* context, const memory_manager::RefCountRequest* request,
+                                     memory_manager::RefCountResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        int new_ref_count = memory_manager->tryIncreaseRefCount(request->id(), request->session_id());
+        response->set_new_ref_count(new_ref_count);
+        response->set_success(new_ref_count != -1);
+        response->set_message(new_ref_count != -1
+            ? "TryIncreaseRefCount operation successful. New RefCount: " + std::to_string(new_ref_count)
+            : "TryIncreaseRefCount operation failed. The block has been released.");
+        return grpc::Status::OK;
+    }
+
     grpc::Status DecreaseRefCount(::grpc::ServerContext* context, const memory_manager::RefCountRequest* request,
                                   memory_manager::RefCountResponse* response) override {
-        int new_ref_count = memory_manager->decreaseRefCount(request->id());
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        int new_ref_count = memory_manager->decreaseRefCount(request->id(), request->session_id());
         response->set_new_ref_count(new_ref_count);
         response->set_success(true);
         response->set_message("DecreaseRefCount operation successful. New RefCount: " + std::to_string(new_ref_count));
         return grpc::Status::OK;
     }
+
+    grpc::Status UpdateRefCounts(::grpc::ServerContext* context, const memory_manager::RefCountBatchRequest* request,
+                                 memory_manager::RefCountBatchResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::vector<std::pair<int, int>> deltas;
+        deltas.reserve(request->deltas_size());
+        for (const auto& delta : request->deltas()) {
+            deltas.emplace_back(delta.id(), delta.delta());
+        }
+
+        bool success = true;
+        for (int new_ref_count : memory_manager->updateRefCounts(deltas, request->session_id())) {
+            response->add_new_ref_counts(new_ref_count);
+            success = success && new_ref_count != -1;
+        }
+        response->set_success(success);
+        response->set_message(success ? "UpdateRefCounts operation successful for " + std::to_string(deltas.size()) + " IDs"
+                                       : "UpdateRefCounts operation failed for some IDs");
+        return grpc::Status::OK;
+    }
+
+    grpc::Status SetReference(::grpc::ServerContext* context, const memory_manager::ReferenceRequest* request,
+                              memory_manager::ReferenceResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        bool success = memory_manager->setReference(request->id(), request->slot(), request->target_id());
+        response->set_success(success);
+        response->set_message(success ? "SetReference operation successful for ID: " + std::to_string(request->id())
+                                       : "SetReference operation failed for ID: " + std::to_string(request->id()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Subscribe(::grpc::ServerContext* context, const memory_manager::SubscribeRequest* request,
+                           ::grpc::ServerWriter<memory_manager::Invalidation>* writer) override {
+        auto subscription = invalidation_hub->subscribe(request->client_id());
+
+        // The empty first message tells the client its cache can start serving reads
+        memory_manager::Invalidation invalidation;
+        bool connected = writer->Write(invalidation);
+        while (connected && !context->IsCancelled()) {
+            std::vector<int> ids = subscription->wait(std::chrono::milliseconds(500));
+            if (ids.empty()) {
+                continue;
+            }
+            invalidation.clear_ids();
+            for (int id : ids) {
+                invalidation.add_ids(id);
+            }
+            connected = writer->Write(invalidation);
+        }
+
+        invalidation_hub->unsubscribe(subscription);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Locate(::grpc::ServerContext* context, const memory_manager::LocateRequest* request,
+                        memory_manager::LocateResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        BlockLocation location;
+        bool success = memory_manager->locate(request->id(), location);
+        response->set_success(success);
+        if (success) {
+            response->set_shm_name(memory_manager->get_shared_memory_name());
+            response->set_offset(location.offset);
+            response->set_size(static_cast<uint32_t>(location.size));
+            response->set_type(location.type);
+            response->set_sequence(location.sequence);
+            response->set_message("Locate operation successful for ID: " + std::to_string(request->id()));
+        } else {
+            response->set_message("Locate operation failed for ID: " + std::to_string(request->id()) +
+                                  ". The block doesn't exist or the chunk isn't shared.");
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Replicate(::grpc::ServerContext* context,
+                           ::grpc::ServerReader<memory_manager::ReplicationBatch>* reader,
+                           memory_manager::ReplicationAck* response) override {
+        if (!memory_manager->is_standby()) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Only a standby accepts replication");
+        }
+
+        memory_manager::ReplicationBatch batch;
+        uint64_t applied_sequence = 0;
+        while (reader->Read(&batch)) {
+            // A promoted standby stops following its old primary
+            if (!memory_manager->is_standby()) {
+                break;
+            }
+            applied_sequence = std::max(applied_sequence, memory_manager->apply_replication(batch));
+        }
+        response->set_applied_sequence(applied_sequence);
+        response->set_success(true);
+        response->set_message("Replicated up to sequence " + std::to_string(applied_sequence));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Promote(::grpc::ServerContext* context, const memory_manager::PromoteRequest* request,
+                         memory_manager::PromoteResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        bool success = memory_manager->promote();
+        response->set_success(success);
+        response->set_message(success ? "Promote operation successful. This server is now the primary."
+                                       : "Promote operation failed. This server is not a standby.");
+        return grpc::Status::OK;
+    }
+
+    grpc::Status OpenSession(::grpc::ServerContext* context, const memory_manager::OpenSessionRequest* request,
+                             memory_manager::SessionResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        std::chrono::milliseconds lease(std::max(request->lease_ms(), 0));
+        std::string session_id = memory_manager->open_session(request->quota_bytes(), lease);
+        response->set_session_id(session_id);
+        response->set_lease_ms(static_cast<int32_t>(lease.count()));
+        response->set_success(true);
+        response->set_message("OpenSession operation successful.");
+        return grpc::Status::OK;
+    }
+
+    grpc::Status RenewSession(::grpc::ServerContext* context, const memory_manager::SessionRequest* request,
+                              memory_manager::SessionResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        std::chrono::milliseconds lease;
+        size_t used;
+        bool success = memory_manager->renew_session(request->session_id(), lease, used);
+        response->set_session_id(request->session_id());
+        response->set_success(success);
+        if (success) {
+            response->set_lease_ms(static_cast<int32_t>(lease.count()));
+            response->set_used_bytes(used);
+            response->set_message("RenewSession operation successful.");
+        } else {
+            response->set_message("RenewSession operation failed. The session is closed or has expired.");
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status CloseSession(::grpc::ServerContext* context, const memory_manager::SessionRequest* request,
+                              memory_manager::SessionResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        size_t released = 0;
+        bool success = memory_manager->close_session(request->session_id(), released);
+        response->set_session_id(request->session_id());
+        response->set_success(success);
+        response->set_released(static_cast<int32_t>(released));
+        response->set_message(success ? "CloseSession operation successful. " + std::to_string(released) + " blocks released."
+                                      : "CloseSession operation failed. The session is closed or has expired.");
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Traverse(::grpc::ServerContext* context, const memory_manager::TraverseRequest* request,
+                          ::grpc::ServerWriter<memory_manager::TraverseResponse>* writer) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (request->slot() < 0 || request->slot() >= MAX_REFERENCE_SLOTS) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Reference slot out of range");
+        }
+
+        // The walk runs under the manager's lock, streaming happens after it is released
+        std::vector<TraversedBlock> path = memory_manager->traverse(request->head_id(), request->slot(), request->limit());
+        memory_manager::TraverseResponse response;
+        for (const TraversedBlock& block : path) {
+            response.set_id(block.id);
+            response.set_value(block.value);
+            response.set_next_id(block.next_id);
+            if (!writer->Write(response)) {
+                break; // Client went away
+            }
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Export(::grpc::ServerContext* context, const memory_manager::ExportRequest* request,
+                        ::grpc::ServerWriter<memory_manager::HeapFrame>* writer) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        size_t frame_bytes = request->frame_bytes() > 0 ? request->frame_bytes() : DEFAULT_EXPORT_FRAME_BYTES;
+        bool complete = memory_manager->export_heap(frame_bytes, [writer](memory_manager::HeapFrame& frame) {
+            return writer->Write(frame);
+        });
+        if (!complete) {
+            return grpc::Status(grpc::StatusCode::CANCELLED, "Export stopped: the client went away");
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Import(::grpc::ServerContext* context, ::grpc::ServerReader<memory_manager::HeapFrame>* reader,
+                        memory_manager::ImportResponse* response) override {
+        BackgroundScheduler::RequestScope request_scope(scheduler);
+        if (memory_manager->is_standby()) {
+            return standby_status();
+        }
+        HeapImport import;
+        memory_manager::HeapFrame frame;
+        while (reader->Read(&frame)) {
+            if (!memory_manager->import_frame(frame, import)) {
+                break;
+            }
+        }
+        if (context->IsCancelled() && import.error.empty()) {
+            // A stream the client gave up on ends like a complete one
+            import.error = "The client cancelled the import";
+        }
+
+        bool success = memory_manager->finish_import(import);
+        if (success) {
+            for (size_t i = 0; i < import.blocks.size(); ++i) {
+                response->add_old_ids(import.exported_ids[i]);
+                response->add_new_ids(import.blocks[i]);
+            }
+            response->set_bytes(import.bytes);
+        }
+        response->set_success(success);
+        response->set_message(success ? "Import operation successful: " + std::to_string(import.blocks.size()) + " blocks"
+                                      : "Import operation failed: " + import.error);
+        response->set_free_memory(memory_manager->get_free_memory());
+        return grpc::Status::OK;
+    }
 };
 
-void parse_arguments(int argc, char* argv[], int& port, size_t& mem_size, std::string& dump_folder) {
+void parse_arguments(int argc, char* argv[], int& port, size_t& mem_size, std::string& dump_folder,
+                     int& cycle_interval_ms, std::string& shm_name, std::string& unix_socket,
+                     std::vector<std::string>& replicas, bool& standby, size_t& max_mem_size,
+                     HeapOptions& heap_options, bool& spill, std::vector<std::string>& pools,
+                     size_t& busy_requests) {
     static struct option long_options[] = {
         {"port", required_argument, 0, 'p'},
         {"memsize", required_argument, 0, 'm'},
+        {"maxmemsize", required_argument, 0, 'M'},
+        {"hugepages", required_argument, 0, 'H'},
+        {"numa", required_argument, 0, 'N'},
+        {"prefault", no_argument, 0, 'P'},
+        {"large-objects", required_argument, 0, 'L'},
+        {"spill", no_argument, 0, 'T'},
         {"dumpFolder", required_argument, 0, 'd'},
+        {"cycleInterval", required_argument, 0, 'c'},
+        {"shm", required_argument, 0, 's'},
+        {"unix", required_argument, 0, 'u'},
+        {"replica", required_argument, 0, 'r'},
+        {"standby", no_argument, 0, 'S'},
+        {"pool", required_argument, 0, 'W'},
+        {"busy-requests", required_argument, 0, 'B'},
         {0, 0, 0, 0}
     };
 
     int opt, option_index = 0;
-    while ((opt = getopt_long(argc, argv, "p:m:d:", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:m:M:H:N:PL:Td:c:s:u:r:SW:B:", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'p':
                 port = std::atoi(optarg);
@@ -265,25 +2428,302 @@ void parse_arguments(int argc, char* argv[], int& port, size_t& mem_size, std::s
             case 'm':
                 mem_size = std::atoi(optarg);
                 break;
+            case 'M':
+                max_mem_size = std::atoi(optarg);
+                break;
+            case 'H':
+                heap_options.huge_pages = parse_huge_pages(optarg);
+                break;
+            case 'N':
+                parse_numa(optarg, heap_options);
+                break;
+            case 'P':
+                heap_options.prefault = true;
+                break;
+            case 'L':
+                // In KB; 0 keeps every block in the heap
+                heap_options.large_object_threshold = static_cast<size_t>(std::atol(optarg)) * 1024;
+                break;
             case 'd':
                 dump_folder = optarg;
                 break;
+            case 'c':
+                cycle_interval_ms = std::atoi(optarg);
+                break;
+            case 's':
+                shm_name = optarg;
+                break;
+            case 'u':
+                unix_socket = optarg;
+                break;
+            case 'r': {
+                // Repeatable, and each value may be a comma-separated list
+                std::stringstream addresses(optarg);
+                std::string address;
+                while (std::getline(addresses, address, ',')) {
+                    if (!address.empty()) {
+                        replicas.push_back(address);
+                    }
+                }
+                break;
+            }
+            case 'S':
+                standby = true;
+                break;
+            case 'T':
+                spill = true;
+                break;
+            case 'W':
+                // Repeatable, one pool per value; applied once the scheduler exists
+                pools.push_back(optarg);
+                break;
+            case 'B':
+                busy_requests = static_cast<size_t>(std::atol(optarg));
+                break;
             default:
                 throw std::invalid_argument("Invalid command-line arguments");
         }
     }
 }
 
+std::string MemoryManager::open_session(size_t quota, std::chrono::milliseconds& lease) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Unguessable, so one client can't renew or close another's session
+    static std::mt19937_64 generator(std::random_device{}());
+    std::string session_id;
+    do {
+        std::ostringstream oss;
+        oss << std::hex << std::setw(16) << std::setfill('0') << generator();
+        session_id = oss.str();
+    } while (sessions.count(session_id) > 0);
+
+    Session& session = sessions[session_id];
+    session.quota = quota;
+    session.lease = lease.count() > 0 ? lease : DEFAULT_SESSION_LEASE;
+    lease = session.lease;
+    session.expires = std::chrono::steady_clock::now() + session.lease;
+    std::cout << "Opened session " << session_id << " with a quota of " << quota << " bytes and a lease of "
+              << session.lease.count() << " ms" << std::endl;
+    return session_id;
+}
+
+bool MemoryManager::renew_session(const std::string& session_id, std::chrono::milliseconds& lease, size_t& used) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(session_id);
+    if (it == sessions.end()) {
+        return false;
+    }
+    Session& session = it->second;
+    session.expires = std::chrono::steady_clock::now() + session.lease;
+    lease = session.lease;
+    used = session.used;
+    return true;
+}
+
+bool MemoryManager::close_session(const std::string& session_id, size_t& released) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sessions.count(session_id) == 0) {
+        return false;
+    }
+    released = close_session_locked(session_id);
+    return true;
+}
+
+// Called periodically by the session reaper. Returns the number of sessions closed.
+size_t MemoryManager::expire_sessions() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::string> expired;
+    for (const auto& [session_id, session] : sessions) {
+        if (session.expires <= now) {
+            expired.push_back(session_id);
+        }
+    }
+    for (const std::string& session_id : expired) {
+        std::cout << "Session " << session_id << " expired" << std::endl;
+        close_session_locked(session_id);
+    }
+    return expired.size();
+}
+
+// Empty session_id always passes. Otherwise the session must exist and have bytes
+// left in its quota; its lease is renewed. Must be called with the mutex held.
+bool MemoryManager::check_session_locked(const std::string& session_id, size_t bytes) {
+    if (session_id.empty()) {
+        return true;
+    }
+    auto it = sessions.find(session_id);
+    if (it == sessions.end()) {
+        std::cerr << "Unknown session " << session_id << std::endl;
+        return false;
+    }
+    Session& session = it->second;
+    if (session.quota > 0 && session.used + bytes > session.quota) {
+        std::cerr << "Session " << session_id << " is over its quota: " << session.used << " + " << bytes
+                  << " > " << session.quota << " bytes" << std::endl;
+        return false;
+    }
+    session.expires = std::chrono::steady_clock::now() + session.lease;
+    return true;
+}
+
+// Must be called with the mutex held
+void MemoryManager::leave_session_locked(int id, const MemoryBlock& block) {
+    auto it = sessions.find(block.session);
+    if (it != sessions.end() && it->second.blocks.erase(id) > 0) {
+        it->second.used -= block.size;
+        it->second.creator_held.erase(id);
+    }
+}
+
+// A client in a session took or dropped a reference. On one of the session's own
+// blocks that is the creator's: a release clears it, and taking one again after
+// restores it. Changes from other clients, and on other blocks, aren't tracked. Must
+// be called with the mutex held when session_id isn't empty.
+void MemoryManager::note_session_reference_locked(const std::string& session_id, int id, int delta) {
+    if (session_id.empty() || delta == 0) {
+        return;
+    }
+    auto it = sessions.find(session_id);
+    if (it == sessions.end() || it->second.blocks.count(id) == 0) {
+        return;
+    }
+    if (delta > 0) {
+        it->second.creator_held.insert(id);
+    } else {
+        it->second.creator_held.erase(id);
+    }
+}
+
+// Frees the session's blocks in one pass with one compaction, instead of block by
+// block through the GC. A block is kept when something outside the session still
+// holds it: a slot of another block, or a count above the session's own references
+// (slots of the session's blocks, plus its creator's one unless the client released
+// it), which means another client took a reference. Kept blocks, and whatever they reach inside the session, outlive
+// it without an owner and with their counts unchanged. Returns the number of blocks
+// freed. Must be called with the mutex held.
+size_t MemoryManager::close_session_locked(const std::string& session_id) {
+    Session session = std::move(sessions.at(session_id));
+    sessions.erase(session_id);
+
+    std::unordered_set<int> kept;
+    std::vector<int> pending;
+    auto keep = [&](int target_id) {
+        if (target_id != -1 && session.blocks.count(target_id) > 0 && kept.insert(target_id).second) {
+            pending.push_back(target_id);
+        }
+    };
+    for (const auto& [id, block] : allocations) {
+        if (session.blocks.count(id) == 0) {
+            for (int target_id : block.references) {
+                keep(target_id);
+            }
+        }
+    }
+    std::unordered_map<int, int> own_references;
+    for (int id : session.blocks) {
+        for (int target_id : allocations.at(id).references) {
+            if (target_id != -1 && session.blocks.count(target_id) > 0) {
+                own_references[target_id]++;
+            }
+        }
+    }
+    for (int id : session.blocks) {
+        int creator_reference = session.creator_held.count(id) > 0 ? 1 : 0;
+        if (allocations.at(id).ref_count->load() > own_references[id] + creator_reference) {
+            keep(id);
+        }
+    }
+    while (!pending.empty()) {
+        int id = pending.back();
+        pending.pop_back();
+        for (int target_id : allocations.at(id).references) {
+            keep(target_id);
+        }
+    }
+
+    // References from freed blocks to surviving ones are dropped once everything is freed
+    std::vector<int> outgoing;
+    size_t released = 0;
+    for (int id : session.blocks) {
+        MemoryBlock& block = allocations.at(id);
+        if (kept.count(id) > 0) {
+            block.session.clear();
+            continue;
+        }
+        for (int target_id : block.references) {
+            if (target_id != -1 && (session.blocks.count(target_id) == 0 || kept.count(target_id) > 0)) {
+                outgoing.push_back(target_id);
+            }
+        }
+        block.ref_count->mark_freed();
+        release_block_memory_locked(block);
+        allocations.erase(id);
+        if (invalidation_hub != nullptr) {
+            invalidation_hub->publish(id);
+        }
+        if (replication_log != nullptr) {
+            replication_log->log_free(id);
+        }
+        ++released;
+    }
+    for (int target_id : outgoing) {
+        release_reference(target_id);
+    }
+
+    std::cout << "Closed session " << session_id << ": released " << released << " blocks, " << kept.size()
+              << " still referenced" << std::endl;
+    if (released > 0) {
+        request_compaction_locked();
+        update_dumps_locked();
+        log_memory_state_locked();
+    }
+    return released;
+}
+
 void MemoryManager::deallocate(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    deallocate_locked(id);
+}
+
+// The count goes from zero to freed in one step, so an increment that got in first
+// keeps the block and one that comes later finds it gone
+bool MemoryManager::deallocate_if_unreferenced(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(id);
+    if (it == allocations.end() || !it->second.ref_count->release(0)) {
+        return false;
+    }
+    deallocate_locked(id);
+    return true;
+}
+
+// The freed bytes of a heap block stay a hole until the next defragment() recomputes
+// memory_offset; a large block is unmapped right away
+void MemoryManager::deallocate_locked(int id) {
     auto it = allocations.find(id);
     if (it != allocations.end()) {
         MemoryBlock& block = it->second;
         std::cout << "Deallocated memory for ID " << id << std::endl;
-        std::memset(block.address, 0, block.size);
+        block.ref_count->mark_freed();
+        release_block_memory_locked(block);
+        leave_session_locked(id, block);
+        std::vector<int> references = std::move(block.references);
         allocations.erase(it);
-        memory_offset -= static_cast<size_t>(block.size);
-
+        if (invalidation_hub != nullptr) {
+            invalidation_hub->publish(id);
+        }
+        if (replication_log != nullptr) {
+            replication_log->log_free(id);
+        }
 
+        // Blocks this one pointed to lose a reference
+        for (int target_id : references) {
+            if (target_id != -1) {
+                release_reference(target_id);
+            }
+        }
     } else {
         std::cerr << "Deallocate failed: ID " << id << " not found." << std::endl;
     }
@@ -293,31 +2733,95 @@ int main(int argc, char* argv[]) {
     try {
         int port = 9999;
         size_t mem_size = 64;
+        size_t max_mem_size = 0; // Ceiling the heap grows to, in MB; 0 keeps it at mem_size
+        HeapOptions heap_options; // Huge pages, NUMA placement and prefaulting of the heap
         std::string dump_folder = "./dumps";
+        int cycle_interval_ms = 1000;
+        std::string shm_name; // Empty keeps the chunk private to the process
+        std::string unix_socket; // Optional socket path for local clients, next to TCP
+        std::vector<std::string> replicas; // Standbys this primary streams its mutations to
+        bool standby = false;
+        bool spill = false; // Evict cold blocks to the dump folder when the heap is full
+        std::vector<std::string> pools; // Worker pool settings, e.g. "defrag:threads=1,nice=10,duty=0.25"
+        size_t busy_requests = 0; // Requests in flight past which the pools throttle; 0 for one per CPU
 
-        parse_arguments(argc, argv, port, mem_size, dump_folder);
+        parse_arguments(argc, argv, port, mem_size, dump_folder, cycle_interval_ms, shm_name, unix_socket,
+                        replicas, standby, max_mem_size, heap_options, spill, pools, busy_requests);
 
-        MemoryManager memory_manager(mem_size, dump_folder);
+        // Before any thread starts, so the collectors and gRPC workers inherit the placement
+        if (heap_options.numa_node >= 0) {
+            bind_threads_to_node(heap_options.numa_node);
+        }
+
+        MemoryManager memory_manager(mem_size, dump_folder, shm_name, max_mem_size, heap_options, spill);
+        memory_manager.set_standby(standby);
 
+        // Client caches are told about writes through the invalidation hub
+        InvalidationHub invalidation_hub;
+        memory_manager.set_invalidation_hub(&invalidation_hub);
+
+        // GC, compaction and dump writing run on their own pools instead of request threads
+        BackgroundScheduler scheduler(busy_requests);
+        for (const std::string& pool : pools) {
+            parse_pool_option(pool, scheduler);
+        }
+        scheduler.start();
+        memory_manager.set_scheduler(&scheduler);
 
         // Create and start the garbage collector
-        GarbageCollector garbage_collector(&memory_manager);
+        GarbageCollector garbage_collector(&memory_manager, &scheduler);
         memory_manager.set_garbage_collector(&garbage_collector);
         garbage_collector.start();
 
+        // Create and start the cycle collector next to it
+        CycleCollector cycle_collector(&memory_manager, std::chrono::milliseconds(cycle_interval_ms));
+        memory_manager.set_cycle_collector(&cycle_collector);
+        cycle_collector.start();
+
+        // Closes sessions whose lease ran out
+        SessionReaper session_reaper(&memory_manager);
+        session_reaper.start();
+
+        // Stream every mutation to the standbys, if any
+        ReplicationLog replication_log(&memory_manager);
+        for (const std::string& replica : replicas) {
+            replication_log.add_standby(replica);
+        }
+        if (replication_log.has_standbys()) {
+            memory_manager.set_replication_log(&replication_log);
+            replication_log.start();
+        }
 
         std::string server_address = "0.0.0.0:" + std::to_string(port);
-        MemoryManagerServiceImpl service(&memory_manager);
+        MemoryManagerServiceImpl service(&memory_manager, &invalidation_hub, &scheduler);
 
         grpc::ServerBuilder builder;
         builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+        if (!unix_socket.empty()) {
+            // A socket left behind by a previous run would make the bind fail
+            std::filesystem::remove(unix_socket);
+            builder.AddListeningPort("unix:" + unix_socket, grpc::InsecureServerCredentials());
+        }
         builder.RegisterService(&service);
         std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
 
         std::cout << "Server listening on " << server_address << std::endl;
+        if (!unix_socket.empty()) {
+            std::cout << "Server listening on unix:" << unix_socket << std::endl;
+        }
+        if (standby) {
+            std::cout << "Running as a standby" << std::endl;
+        }
         server->Wait();
 
+        replication_log.stop();
+        session_reaper.stop();
+        cycle_collector.stop();
         garbage_collector.stop();
+
+        // Finishes the queued collections, compactions and dumps
+        scheduler.stop();
+        memory_manager.set_scheduler(nullptr);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return EXIT_FAILURE;
@@ -1,56 +1,291 @@
 #ifndef MEM_MGR_H
 #define MEM_MGR_H
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "dumps/dumps.h"
+#include "shared_memory/shared_memory.h"
+#include "heap/segmented_heap.h"
+#include "heap/large_object_space.h"
+#include "tiering/spill_file.h"
+#include "refcount/ref_count_table.h"
 
 class GarbageCollector;
+class CycleCollector;
+class InvalidationHub;
+class ReplicationLog;
+class BackgroundScheduler;
+
+namespace memory_manager {
+class ReplicationEntry;
+class ReplicationBatch;
+class HeapFrame;
+}
+
+// Number of pointer slots a block can hold
+constexpr int MAX_REFERENCE_SLOTS = 16;
+
+// Array blocks start on a cache line so bulk loops over them can use aligned vector loads
+constexpr size_t ARRAY_ALIGNMENT = 64;
+
+// Most element bytes one GetRange returns, well below gRPC's default 4 MB message limit.
+// A longer range comes back short and the client asks for the rest.
+constexpr size_t MAX_RANGE_BYTES = 3 * 1024 * 1024;
+
+struct TraversedBlock {
+    int id;
+    std::string value;
+    int next_id;
+};
+
+struct BlockLocation {
+    uint64_t offset;
+    size_t size;
+    std::string type;
+    uint64_t sequence;
+};
+
+// One operation of a transaction, see MemoryManager::transact
+struct TransactionOp {
+    enum class Kind { Read, Compare, Set, SetReference };
+    Kind kind;
+    int id;
+    std::string value;
+    int slot = 0;
+    int target_id = -1;
+};
+
+// Operations of MemoryManager::compute
+enum class ComputeOp { Sum, Min, Max, CountGreater, CountLess, AddScalar, Scale };
+
+// Most blocks one reserve() creates, far above a client pool's batch but small enough
+// that one request can't flood the allocation map
+constexpr size_t MAX_RESERVE_BLOCKS = 4096;
+
+// Lease of a session opened without one
+constexpr std::chrono::milliseconds DEFAULT_SESSION_LEASE{30000};
+
+// Blocks created under one client session, released together when it ends
+struct Session {
+    size_t quota; // Bytes its blocks may take, 0 for no limit
+    size_t used = 0;
+    std::chrono::milliseconds lease;
+    std::chrono::steady_clock::time_point expires;
+    std::unordered_set<int> blocks;
+    std::unordered_set<int> creator_held; // Blocks whose creator's reference the client hasn't released
+};
+
+// Block bytes per Export frame unless the client asks for another size. Frames are
+// capped well below gRPC's default 4 MB message limit.
+constexpr size_t DEFAULT_EXPORT_FRAME_BYTES = 1024 * 1024;
+constexpr size_t MAX_EXPORT_FRAME_BYTES = 3 * 1024 * 1024;
+
+// Progress of one Import stream, see MemoryManager::import_frame
+struct HeapImport {
+    std::unordered_map<int, int> ids; // Exported id -> the id it was given here
+    std::vector<int> exported_ids;    // In the order their bytes arrive
+    std::vector<int> blocks;          // The ids given here, in the same order
+    std::vector<std::pair<int, std::vector<int>>> references; // Exported slots, filled in at the end
+    size_t filling = 0; // Index into blocks of the one the next bytes belong to
+    size_t filled = 0;  // Bytes of it already copied
+    size_t bytes = 0;
+    std::string error;  // Set once the import failed
+};
+
+// Layout of a client-defined type, whose values are stored and sent as raw bytes
+struct RegisteredType {
+    size_t size;
+    size_t alignment;
+};
 
 struct MemoryBlock {
     void* address;
     size_t size;
     std::string type;
-    int ref_count;
+    RefCount* ref_count; // Entry in the manager's ref count table, changed without its lock
+    std::vector<int> references; // Outgoing pointer slots, -1 when empty
+    size_t count = 1; // Elements of type; more than one makes it an array block
+    size_t alignment = 1; // Of a registered type's elements
+    bool large = false; // Lives in the large-object space: outside the chunk and never moved
+    bool referenced = true; // Clock bit: set by every access, cleared by eviction sweeps
+    bool spilled = false; // Evicted to the spill file at spill_offset; address is null meanwhile
+    size_t spill_offset = 0;
+    std::string session; // Session that created it, empty for none
 };
 
+inline size_t block_alignment(const MemoryBlock& block) {
+    return block.count > 1 ? ARRAY_ALIGNMENT : block.alignment;
+}
+
+inline size_t align_offset(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
 class MemoryManager {
 private:
     void* memory_chunk;
-    size_t memory_chunk_size;
+    std::unique_ptr<SharedMemoryChunk> shared_chunk; // Set when the chunk lives in shared memory
+    std::unique_ptr<SegmentedHeap> heap; // Grows memory_chunk segment by segment
+    std::unique_ptr<LargeObjectSpace> large_objects; // Blocks over the threshold, one mapping each
+    std::unique_ptr<SpillFile> spill_file; // Set when cold blocks may be evicted to disk
+    int clock_hand = 0; // Id the next eviction sweep starts from
+    size_t memory_chunk_size; // The ceiling the heap and the large objects together may grow to
     size_t memory_offset = 0;
     int next_id = 1;
     std::unordered_map<int, MemoryBlock> allocations;
+    std::unordered_map<std::string, RegisteredType> registered_types;
+    std::unordered_map<std::string, Session> sessions;
+    RefCountTable ref_counts;
     Dumps dumps;
     GarbageCollector* garbage_collector = nullptr;
+    CycleCollector* cycle_collector = nullptr;
+    InvalidationHub* invalidation_hub = nullptr;
+    ReplicationLog* replication_log = nullptr; // Set on a primary with standbys
+    std::atomic<bool> standby{false}; // A standby only changes through apply_replication()
+    BackgroundScheduler* scheduler = nullptr; // Runs dumps and compactions off the request threads
+    bool dump_queued = false; // A dump task is queued and will pick up later changes too
+    bool detailed_dump_requested = false;
+    bool compaction_queued = false;
+    std::mutex dump_mutex; // Serializes the dump tasks' file writes
+
+    // Guards allocations and the chunk against the request and collector threads
+    mutable std::mutex mutex;
+
+    void update_dumps_locked();
+    void log_memory_state_locked();
+    std::string format_memory_state_locked() const;
+    void schedule_dump_locked(bool detailed);
+    void request_compaction_locked();
+    void deallocate_locked(int id);
+    void release_reference(int target_id);
+    int change_ref_count(int id, int delta);
+    void publish_write_locked(int id, const MemoryBlock& block, const std::string& origin_client_id,
+                              size_t offset = 0, size_t length = 0);
+    void defragment_locked();
+    bool has_room_locked(size_t heap_end, size_t large_bytes);
+    bool make_room_locked(size_t heap_bytes, size_t large_bytes, const std::vector<int>& keep);
+    bool evict_locked(size_t bytes, const std::vector<int>& keep);
+    bool touch_locked(int id, MemoryBlock& block, std::vector<int> keep = {});
+    void release_block_memory_locked(MemoryBlock& block);
+    bool register_type_locked(const std::string& name, size_t size, size_t alignment);
+    bool check_layout_locked(int size, const std::string& type, size_t count, size_t& alignment) const;
+    int place_block_locked(int size, const std::string& type, size_t count, size_t alignment,
+                           const std::string& session_id = "");
+    bool check_session_locked(const std::string& session_id, size_t bytes);
+    void leave_session_locked(int id, const MemoryBlock& block);
+    void note_session_reference_locked(const std::string& session_id, int id, int delta);
+    size_t close_session_locked(const std::string& session_id);
+    bool encode_value_locked(const MemoryBlock& block, const std::string& value, void* output) const;
+    std::string decode_value_locked(const MemoryBlock& block, const void* address) const;
 
 public:
-    MemoryManager(size_t size_mb, const std::string& folder);
+    MemoryManager(size_t size_mb, const std::string& folder, const std::string& shm_name = "", size_t max_size_mb = 0,
+                  const HeapOptions& heap_options = {}, bool spill_to_disk = false);
     ~MemoryManager();
 
     void* get_memory_chunk() const;
     size_t get_memory_chunk_size() const;
+    size_t get_committed_memory() const;
     size_t get_memory_offset() const;
+    size_t get_free_memory() const;
     size_t get_allocations_count() const;
     int get_next_id() const;
 
     void update_dumps();
     void log_memory_state();
 
-    int create(int size, const std::string& type);
-    bool set(int id, const std::string& value);
+    int create(int size, const std::string& type, size_t count = 1, const std::string& session_id = "");
+    std::vector<int> reserve(int size, const std::string& type, size_t blocks, const std::string& session_id = "");
+    bool register_type(const std::string& name, size_t size, size_t alignment);
+    bool set(int id, const std::string& value, const std::string& origin_client_id = "");
     std::string get(int id);
-    int increaseRefCount(int id);
-    int decreaseRefCount(int id);
+    bool get_range(int id, size_t first, size_t count, std::string& data, std::string& type, size_t& total_count);
+    bool set_range(int id, size_t first, const std::string& data, const std::string& origin_client_id = "");
+    bool compute(int id, ComputeOp op, size_t first, size_t count, double operand, std::string& result,
+                 size_t& elements, const std::string& origin_client_id = "");
+    bool fetch_add(int id, const std::string& delta, std::string& previous, std::string& current,
+                   const std::string& origin_client_id = "");
+    bool compare_and_swap(int id, const std::string& expected, const std::string& desired, bool& exchanged,
+                          std::string& previous, std::string& current, const std::string& origin_client_id = "");
+    bool exchange(int id, const std::string& value, std::string& previous, std::string& current,
+                  const std::string& origin_client_id = "");
+    int increaseRefCount(int id, const std::string& session_id = "");
+    int decreaseRefCount(int id, const std::string& session_id = "");
+    int tryIncreaseRefCount(int id, const std::string& session_id = "");
+    bool transact(const std::vector<TransactionOp>& ops, std::vector<std::string>& reads, int& failed_op,
+                  std::string& error, const std::string& origin_client_id = "");
+    std::vector<int> updateRefCounts(const std::vector<std::pair<int, int>>& deltas,
+                                     const std::string& session_id = "");
+    bool setReference(int id, int slot, int target_id);
+    std::vector<TraversedBlock> traverse(int head_id, int slot, int limit);
+    bool locate(int id, BlockLocation& location);
+    std::string get_shared_memory_name() const;
 
     void deallocate(int id);
+    bool deallocate_if_unreferenced(int id);
+    size_t collect_cycles(const std::vector<int>& candidates);
     void defragment();
+    void schedule_defragment();
+
+    // Sessions. Closing one, or its lease running out, frees its blocks at once, except
+    // those another block or another client still holds (see close_session_locked).
+    // A lease of 0 takes the default; lease is set to the one granted.
+    std::string open_session(size_t quota, std::chrono::milliseconds& lease);
+    bool renew_session(const std::string& session_id, std::chrono::milliseconds& lease, size_t& used);
+    bool close_session(const std::string& session_id, size_t& released);
+    size_t expire_sessions();
+
+    // Bulk copy between servers. export_heap hands frames to write outside the lock and stops
+    // when it returns false; each block is copied whole, but blocks created or freed while it
+    // runs may be left out. An import is all or nothing: finish_import frees every block of a
+    // failed one.
+    bool export_heap(size_t frame_bytes, const std::function<bool(memory_manager::HeapFrame&)>& write);
+    bool import_frame(const memory_manager::HeapFrame& frame, HeapImport& import);
+    bool finish_import(HeapImport& import);
+
+    // Replication: the primary's snapshot for a (re)connecting standby, taken a piece at a
+    // time so the lock is never held for a copy of the whole heap, and the standby's side
+    std::vector<int> replication_snapshot_begin(
+        const std::function<void(std::vector<memory_manager::ReplicationEntry>&)>& install);
+    size_t replication_snapshot_next(const std::vector<int>& ids, size_t next, size_t max_bytes,
+                                     const std::function<void(std::vector<memory_manager::ReplicationEntry>&)>& install);
+    uint64_t apply_replication(const memory_manager::ReplicationBatch& batch);
+    bool is_standby() const;
+    bool promote();
 
     void set_garbage_collector(GarbageCollector* gc) {
         garbage_collector = gc;
     }
 
+    void set_cycle_collector(CycleCollector* cc) {
+        cycle_collector = cc;
+    }
+
+    void set_invalidation_hub(InvalidationHub* hub) {
+        invalidation_hub = hub;
+    }
+
+    void set_replication_log(ReplicationLog* log) {
+        replication_log = log;
+    }
+
+    void set_standby(bool is_standby) {
+        standby = is_standby;
+    }
+
+    void set_scheduler(BackgroundScheduler* background_scheduler) {
+        scheduler = background_scheduler;
+    }
+
     const std::unordered_map<int, MemoryBlock>& get_allocations() const {
         return allocations;
     }
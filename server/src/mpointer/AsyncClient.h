@@ -0,0 +1,96 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "proto/hello.grpc.pb.h"
+
+// Issues unary RPCs through the async stub and runs their completions on one
+// completion-queue thread, so a caller can keep many operations in flight.
+class AsyncClient {
+private:
+    // One in-flight RPC; the completion queue hands it back as the tag
+    struct Call {
+        virtual ~Call() = default;
+        virtual void complete() = 0;
+    };
+
+    template <typename Response>
+    struct UnaryCall : Call {
+        grpc::ClientContext context;
+        Response response;
+        grpc::Status status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader;
+        std::function<void(const grpc::Status&, const Response&)> done;
+
+        void complete() override {
+            done(status, response);
+        }
+    };
+
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    std::unique_ptr<grpc::CompletionQueue> cq_;
+    std::thread cq_thread_;
+    std::mutex mutex_;
+
+    void drain(grpc::CompletionQueue* cq) {
+        void* tag;
+        bool ok;
+        while (cq->Next(&tag, &ok)) {
+            // Finish always reports ok; failures are carried in the call's status
+            std::unique_ptr<Call> call(static_cast<Call*>(tag));
+            call->complete();
+        }
+    }
+
+public:
+    AsyncClient() = default;
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    ~AsyncClient() {
+        stop();
+    }
+
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub) {
+        stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stub_ = std::move(stub);
+        cq_ = std::make_unique<grpc::CompletionQueue>();
+        cq_thread_ = std::thread(&AsyncClient::drain, this, cq_.get());
+    }
+
+    // Lets calls already in flight complete, then stops the completion thread
+    void stop() {
+        std::unique_ptr<grpc::CompletionQueue> cq;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!cq_) {
+                return;
+            }
+            cq_->Shutdown();
+            cq.swap(cq_);
+        }
+        if (cq_thread_.joinable()) {
+            cq_thread_.join();
+        }
+    }
+
+    // Starts an RPC. prepare is called with the stub, the call's context and the queue and
+    // returns the stub's PrepareAsync reader; done runs on the completion thread.
+    template <typename Response, typename Prepare>
+    void call(Prepare prepare, std::function<void(const grpc::Status&, const Response&)> done) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cq_) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+
+        auto* call = new UnaryCall<Response>();
+        call->done = std::move(done);
+        call->reader = prepare(stub_.get(), &call->context, cq_.get());
+        call->reader->StartCall();
+        call->reader->Finish(&call->response, &call->status, call);
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "proto/hello.grpc.pb.h"
+
+// Blocks reserved ahead of time so New() doesn't need a round trip. One Reserve
+// RPC creates a whole batch of adjacent blocks; pop() hands them out locally and
+// a background thread reserves the next batch once fewer than low_water remain.
+// Each pooled id carries the reference Reserve counted, which New() adopts.
+class BlockPool {
+private:
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    std::deque<int> ids_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread refill_thread_;
+    bool enabled_ = false;
+    bool should_stop_ = false;
+
+    int block_size_ = 0;
+    std::string type_;
+    std::string session_id_;
+    size_t batch_ = 256;
+    size_t low_water_ = 64;
+    std::atomic<uint64_t>* free_memory_ = nullptr;
+
+    bool reserve(std::vector<int>* ids) {
+        memory_manager::ReserveRequest request;
+        request.set_size(block_size_);
+        request.set_type(type_);
+        request.set_blocks(static_cast<int>(batch_));
+        request.set_session_id(session_id_);
+
+        memory_manager::ReserveResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->Reserve(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            std::cerr << "Failed to refill block pool: "
+                      << (status.ok() ? response.message() : status.error_message()) << std::endl;
+            return false;
+        }
+        if (free_memory_ != nullptr) {
+            free_memory_->store(response.free_memory());
+        }
+        ids->assign(response.ids().begin(), response.ids().end());
+        return true;
+    }
+
+    void refillLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!should_stop_) {
+            cv_.wait(lock, [this] { return should_stop_ || ids_.size() < low_water_; });
+            if (should_stop_) {
+                break;
+            }
+            lock.unlock();
+            std::vector<int> ids;
+            bool reserved = reserve(&ids);
+            lock.lock();
+            ids_.insert(ids_.end(), ids.begin(), ids.end());
+            if (!reserved) {
+                // New() falls back to Create meanwhile; don't hammer a full server
+                cv_.wait_for(lock, std::chrono::seconds(1), [this] { return should_stop_; });
+            }
+        }
+    }
+
+public:
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    ~BlockPool() {
+        stop();
+    }
+
+    // Starts reserving blocks of block_size bytes of type, batch at a time.
+    // free_memory, if given, is updated from every Reserve response. The blocks
+    // belong to session_id, if given.
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub, int block_size, const std::string& type,
+               size_t batch, size_t low_water, std::atomic<uint64_t>* free_memory,
+               const std::string& session_id = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (enabled_) {
+            return;
+        }
+        stub_ = std::move(stub);
+        block_size_ = block_size;
+        type_ = type;
+        batch_ = std::max<size_t>(batch, 1);
+        low_water_ = std::min(std::max<size_t>(low_water, 1), batch_);
+        free_memory_ = free_memory;
+        session_id_ = session_id;
+        should_stop_ = false;
+        enabled_ = true;
+        refill_thread_ = std::thread(&BlockPool::refillLoop, this);
+    }
+
+    // Stops refilling and returns the ids that were never handed out; the caller
+    // owns their references and must release them
+    std::vector<int> stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            should_stop_ = true;
+            enabled_ = false;
+        }
+        cv_.notify_one();
+        if (refill_thread_.joinable()) {
+            refill_thread_.join();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<int> unused(ids_.begin(), ids_.end());
+        ids_.clear();
+        return unused;
+    }
+
+    // Takes a reserved id. Returns false when the pool is off or momentarily empty.
+    bool pop(int* id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || ids_.empty()) {
+            if (enabled_) {
+                cv_.notify_one();
+            }
+            return false;
+        }
+        *id = ids_.front();
+        ids_.pop_front();
+        if (ids_.size() < low_water_) {
+            cv_.notify_one();
+        }
+        return true;
+    }
+};
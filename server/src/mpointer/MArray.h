@@ -0,0 +1,270 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "proto/hello.grpc.pb.h"
+#include "MPointer.h"
+
+// A block holding count elements of T. Elements move in bulk as raw bytes through
+// GetRange/SetRange, a few megabytes per RPC, so reading a million doubles takes three
+// RPCs instead of a million. Shares MPointer<T>'s servers and reference counting; call
+// MPointer<T>::Init first.
+template <typename T>
+class MArray {
+private:
+    static_assert(std::is_trivially_copyable<T>::value, "MArray elements are copied as raw bytes");
+
+    // Element bytes per SetRange, under gRPC's default 4 MB message limit. GetRange
+    // answers are capped by the server.
+    static constexpr size_t WRITE_CHUNK_BYTES = 2 * 1024 * 1024;
+
+    int id_;
+    mutable size_t size_; // 0 until known for an array adopted by id
+
+    void increaseRefCount() {
+        if (id_ != -1) {
+            MPointer<T>::shardFor(id_).ledger.acquire(localId(id_));
+        }
+    }
+
+    void decreaseRefCount() {
+        if (id_ != -1) {
+            MPointer<T>::shardFor(id_).ledger.release(localId(id_));
+        }
+    }
+
+    ShardConnection& shard() const {
+        if (id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
+        }
+        return MPointer<T>::shardFor(id_);
+    }
+
+    std::string compute(memory_manager::ComputeRequest::Op op, size_t first, size_t count, double operand) const {
+        memory_manager::ComputeRequest request;
+        request.set_id(localId(id_));
+        request.set_op(op);
+        request.set_first(static_cast<uint32_t>(first));
+        request.set_count(static_cast<uint32_t>(count));
+        request.set_operand(operand);
+        request.set_client_id(shard().cache.clientId());
+
+        memory_manager::ComputeResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = shard().stub->Compute(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            throw std::runtime_error("Failed to compute on array: " + (status.ok() ? response.message() : status.error_message()));
+        }
+        return response.result();
+    }
+
+public:
+    // Integer arrays sum without overflow, floating point ones in double precision
+    using SumType = typename std::conditional<std::is_integral<T>::value, long long, double>::type;
+
+    MArray() : id_(-1), size_(0) {}
+
+    explicit MArray(int id) : id_(id), size_(0) {
+        increaseRefCount();
+    }
+
+    MArray(const MArray& other) : id_(other.id_), size_(other.size_) {
+        increaseRefCount();
+    }
+
+    MArray(MArray&& other) noexcept : id_(other.id_), size_(other.size_) {
+        other.id_ = -1;
+    }
+
+    MArray& operator=(const MArray& other) {
+        if (this != &other) {
+            decreaseRefCount();
+            id_ = other.id_;
+            size_ = other.size_;
+            increaseRefCount();
+        }
+        return *this;
+    }
+
+    MArray& operator=(MArray&& other) noexcept {
+        if (this != &other) {
+            decreaseRefCount();
+            id_ = other.id_;
+            size_ = other.size_;
+            other.id_ = -1;
+        }
+        return *this;
+    }
+
+    ~MArray() {
+        decreaseRefCount();
+    }
+
+    // Create an array of count elements on the least-loaded server. The server
+    // places it on a 64-byte boundary.
+    static MArray<T> New(size_t count) {
+        if (count == 0) {
+            throw std::invalid_argument("MArray needs at least one element");
+        }
+        size_t shard_index = MPointer<T>::placeNewBlock();
+        ShardConnection& shard = *MPointer<T>::shards_[shard_index];
+        MPointer<T>::ensureTypeRegistered(shard);
+
+        memory_manager::CreateRequest request;
+        request.set_size(static_cast<int>(sizeof(T) * count));
+        request.set_type(MPointer<T>::typeName());
+        request.set_count(static_cast<int>(count));
+        request.set_session_id(shard.session.id());
+
+        memory_manager::CreateResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = shard.stub->Create(&context, request, &response);
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to create array: " + status.error_message());
+        }
+        shard.free_memory.store(response.free_memory());
+        if (!response.success()) {
+            throw std::runtime_error("Failed to create array: " + response.message());
+        }
+
+        MArray<T> array;
+        shard.ledger.adopt(response.id());
+        array.id_ = encodeShardId(shard_index, response.id());
+        array.size_ = count;
+        return array;
+    }
+
+    // Copy count elements starting at first into out. count 0 reads to the end.
+    // Returns the number of elements copied. A long range takes several RPCs.
+    size_t read(size_t first, T* out, size_t count) const {
+        size_t copied = 0;
+        while (true) {
+            memory_manager::GetRangeRequest request;
+            request.set_id(localId(id_));
+            request.set_first(static_cast<uint32_t>(first + copied));
+            request.set_count(static_cast<uint32_t>(count == 0 ? 0 : count - copied));
+
+            memory_manager::GetRangeResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = shard().stub->GetRange(&context, request, &response);
+            if (!status.ok() || !response.success()) {
+                throw std::runtime_error("Failed to read array: " + (status.ok() ? response.message() : status.error_message()));
+            }
+            if (response.type() != MPointer<T>::typeName()) {
+                throw std::runtime_error("Array holds " + response.type() + ", not " + MPointer<T>::typeName());
+            }
+
+            size_ = response.total_count();
+            size_t received = response.data().size() / sizeof(T);
+            std::memcpy(out + copied, response.data().data(), received * sizeof(T));
+            copied += received;
+            if (received == 0 || (count != 0 && copied >= count) || first + copied >= size_) {
+                return copied;
+            }
+        }
+    }
+
+    // Read a range (by default the whole array) into a vector
+    std::vector<T> read(size_t first = 0, size_t count = 0) const {
+        std::vector<T> values(count == 0 ? size() - std::min(first, size()) : count);
+        values.resize(read(first, values.data(), values.size()));
+        return values;
+    }
+
+    // Overwrite count elements starting at first. A long range is sent in several
+    // RPCs, so other clients may see it partly written.
+    void write(size_t first, const T* values, size_t count) {
+        size_t chunk = std::max<size_t>(WRITE_CHUNK_BYTES / sizeof(T), 1);
+        size_t written = 0;
+        do {
+            size_t elements = std::min(chunk, count - written);
+            memory_manager::SetRangeRequest request;
+            request.set_id(localId(id_));
+            request.set_first(static_cast<uint32_t>(first + written));
+            request.set_data(reinterpret_cast<const char*>(values + written), elements * sizeof(T));
+            request.set_client_id(shard().cache.clientId());
+
+            memory_manager::SetRangeResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = shard().stub->SetRange(&context, request, &response);
+            if (!status.ok() || !response.success()) {
+                throw std::runtime_error("Failed to write array: " + (status.ok() ? response.message() : status.error_message()));
+            }
+            written += elements;
+        } while (written < count);
+    }
+
+    void write(size_t first, const std::vector<T>& values) {
+        write(first, values.data(), values.size());
+    }
+
+    // Single elements, one RPC each; prefer the bulk calls in loops
+    T get(size_t index) const {
+        T value;
+        if (read(index, &value, 1) != 1) {
+            throw std::out_of_range("Array index " + std::to_string(index) + " out of range");
+        }
+        return value;
+    }
+
+    void set(size_t index, const T& value) {
+        write(index, &value, 1);
+    }
+
+    // Server-side reductions over [first, first + count); count 0 runs to the end.
+    // Only the result comes back over the wire.
+    SumType sum(size_t first = 0, size_t count = 0) const {
+        std::string result = compute(memory_manager::ComputeRequest::SUM, first, count, 0);
+        if constexpr (std::is_integral<T>::value) {
+            return std::stoll(result);
+        } else {
+            return std::stod(result);
+        }
+    }
+
+    T min(size_t first = 0, size_t count = 0) const {
+        return MPointer<T>::parseValue(compute(memory_manager::ComputeRequest::MIN, first, count, 0));
+    }
+
+    T max(size_t first = 0, size_t count = 0) const {
+        return MPointer<T>::parseValue(compute(memory_manager::ComputeRequest::MAX, first, count, 0));
+    }
+
+    size_t countGreater(T threshold, size_t first = 0, size_t count = 0) const {
+        return std::stoull(compute(memory_manager::ComputeRequest::COUNT_GREATER, first, count, threshold));
+    }
+
+    size_t countLess(T threshold, size_t first = 0, size_t count = 0) const {
+        return std::stoull(compute(memory_manager::ComputeRequest::COUNT_LESS, first, count, threshold));
+    }
+
+    // Server-side element-wise updates, in place
+    void add(T value, size_t first = 0, size_t count = 0) {
+        compute(memory_manager::ComputeRequest::ADD_SCALAR, first, count, value);
+    }
+
+    void scale(T factor, size_t first = 0, size_t count = 0) {
+        compute(memory_manager::ComputeRequest::SCALE, first, count, factor);
+    }
+
+    // Number of elements, asked from the server the first time for an array adopted by id
+    size_t size() const {
+        if (size_ == 0 && id_ != -1) {
+            T first;
+            read(0, &first, 1);
+        }
+        return size_;
+    }
+
+    int getId() const {
+        return id_;
+    }
+
+    bool isNull() const {
+        return id_ == -1;
+    }
+};
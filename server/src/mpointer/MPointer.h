@@ -1,39 +1,243 @@
 #pragma once
 #include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <future>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include <iostream>
 #include <stdexcept>
 #include "proto/hello.grpc.pb.h"
+#include "ShardConnection.h"
+#include "TypeCodec.h"
+
+class MTransaction;
+
+template <typename T>
+class MArray;
+
+template <typename T>
+class MWeakPointer;
 
 template <typename T>
 class MPointer {
 private:
-    static std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    friend class MTransaction;
+    friend class MArray<T>;
+    friend class MWeakPointer<T>;
+
+    static std::vector<std::unique_ptr<ShardConnection>> shards_;
+    static std::atomic<size_t> next_shard_;
     int id_;
-    int next_id_;
+
+    // Types the server parses from text; any other T goes through TypeCodec<T>
+    static constexpr bool isBuiltin = std::is_same<T, int>::value || std::is_same<T, float>::value ||
+                                      std::is_same<T, double>::value || std::is_same<T, bool>::value;
     
-    // Handle reference counting properly
+    // Handle reference counting properly. The ledger keeps the per-id local counts
+    // and only talks to the server when this process starts or stops holding an id.
     void increaseRefCount() {
         if (id_ != -1) {
-            memory_manager::RefCountRequest request;
-            request.set_id(id_);
-            memory_manager::RefCountResponse response;
-            grpc::ClientContext context;
-            stub_->IncreaseRefCount(&context, request, &response);
+            shardFor(id_).ledger.acquire(localId(id_));
         }
     }
     
     void decreaseRefCount() {
         if (id_ != -1) {
-            memory_manager::RefCountRequest request;
-            request.set_id(id_);
-            memory_manager::RefCountResponse response;
-            grpc::ClientContext context;
-            stub_->DecreaseRefCount(&context, request, &response);
+            shardFor(id_).ledger.release(localId(id_));
+        }
+    }
+
+    // Server that owns id
+    static ShardConnection& shardFor(int id) {
+        size_t index = shardIndex(id);
+        if (index >= shards_.size()) {
+            throw std::runtime_error(shards_.empty() ? "MPointer not initialized. Call Init() first."
+                                                     : "No server for ID " + std::to_string(id));
+        }
+        return *shards_[index];
+    }
+
+    // Least-loaded placement: the server that reported the most free memory. Servers
+    // that haven't reported yet come first, and ties rotate between servers.
+    static size_t placeNewBlock() {
+        if (shards_.empty()) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+        size_t start = next_shard_.fetch_add(1) % shards_.size();
+        size_t best = start;
+        for (size_t i = 1; i < shards_.size(); ++i) {
+            size_t index = (start + i) % shards_.size();
+            if (shards_[index]->free_memory.load() > shards_[best]->free_memory.load()) {
+                best = index;
+            }
+        }
+        return best;
+    }
+
+    // Convert a value string sent by the server
+    static T parseValue(const std::string& valueStr) {
+        if (valueStr.find("No value assigned") != std::string::npos) {
+            return T(); // Default value
+        }
+
+        if constexpr (std::is_same<T, int>::value) {
+            return std::stoi(valueStr);
+        } else if constexpr (std::is_same<T, float>::value) {
+            return std::stof(valueStr);
+        } else if constexpr (std::is_same<T, double>::value) {
+            return std::stod(valueStr);
+        } else if constexpr (std::is_same<T, bool>::value) {
+            return valueStr == "true";
+        } else {
+            return TypeCodec<T>::decode(valueStr);
         }
     }
 
+    // Convert a value to the string the server expects
+    static std::string formatValue(const T& value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            return value ? "true" : "false";
+        } else if constexpr (std::is_same<T, int>::value ||
+                             std::is_same<T, float>::value ||
+                             std::is_same<T, double>::value) {
+            return std::to_string(value);
+        } else {
+            return TypeCodec<T>::encode(value);
+        }
+    }
+
+    // Tells the server T's layout before the first block of it is created there
+    static void ensureTypeRegistered(ShardConnection& shard) {
+        if (isBuiltin || shard.type_registered.load()) {
+            return;
+        }
+
+        memory_manager::RegisterTypeRequest request;
+        request.set_name(TypeCodec<T>::name());
+        request.set_size(static_cast<uint32_t>(TypeCodec<T>::size));
+        request.set_alignment(static_cast<uint32_t>(TypeCodec<T>::alignment));
+
+        memory_manager::RegisterTypeResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = shard.stub->RegisterType(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            throw std::runtime_error("Failed to register type " + request.name() + ": " +
+                                     (status.ok() ? response.message() : status.error_message()));
+        }
+        shard.type_registered.store(true);
+    }
+
+    // Server for an atomic operation on this block. Queued write-back values are sent
+    // first so the operation sees them.
+    ShardConnection& atomicShard() const {
+        if (id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
+        }
+        ShardConnection& shard = shardFor(id_);
+        if (shard.cache.writeBack()) {
+            shard.cache.flush();
+        }
+        return shard;
+    }
+
+    // Checks an atomic RPC's outcome and refreshes the local cache with the new value.
+    // version is the cache's, taken before the RPC.
+    static void finishAtomic(ShardConnection& shard, int id, const char* operation, uint64_t version,
+                             const grpc::Status& status, const memory_manager::AtomicResponse& response) {
+        if (!status.ok() || !response.success()) {
+            throw std::runtime_error(std::string("Failed to ") + operation + ": " +
+                                     (status.ok() ? response.message() : status.error_message()));
+        }
+        shard.cache.update(id, response.current(), version);
+    }
+
+    // Streams the nodes into path and returns the next id after the last one received.
+    // Links never cross servers, so every id in the walk belongs to this pointer's shard.
+    int streamList(int limit, std::vector<std::pair<int, T>>* path) const {
+        if (id_ == -1) {
+            return -1;
+        }
+
+        size_t shard = shardIndex(id_);
+        memory_manager::TraverseRequest request;
+        request.set_head_id(localId(id_));
+        request.set_slot(0);
+        request.set_limit(limit);
+
+        grpc::ClientContext context;
+        std::unique_ptr<grpc::ClientReader<memory_manager::TraverseResponse>> reader(
+            shardFor(id_).stub->Traverse(&context, request));
+
+        memory_manager::TraverseResponse response;
+        int next_id = -1;
+        while (reader->Read(&response)) {
+            path->emplace_back(encodeShardId(shard, response.id()), parseValue(response.value()));
+            next_id = response.next_id() == -1 ? -1 : encodeShardId(shard, response.next_id());
+        }
+
+        grpc::Status status = reader->Finish();
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to traverse: " + status.error_message());
+        }
+        return next_id;
+    }
+
+    // Server type name of T, used by Create and checked by the shared-memory path
+    static std::string typeName() {
+        if (std::is_same<T, int>::value) {
+            return "int";
+        } else if (std::is_same<T, float>::value) {
+            return "float";
+        } else if (std::is_same<T, double>::value) {
+            return "double";
+        } else if (std::is_same<T, bool>::value) {
+            return "bool";
+        }
+        return TypeCodec<T>::name();
+    }
+
+    // Creates a block of type T on the given server
+    static MPointer<T> createOn(size_t shard_index) {
+        ShardConnection& shard = *shards_[shard_index];
+        MPointer<T> pointer;
+
+        // A reserved block is ready to use, no round trip needed
+        int pooled_id;
+        if (shard.pool.pop(&pooled_id)) {
+            shard.ledger.adopt(pooled_id);
+            pointer.id_ = encodeShardId(shard_index, pooled_id);
+            return pointer;
+        }
+        ensureTypeRegistered(shard);
+
+        memory_manager::CreateRequest request;
+        request.set_size(sizeof(T));
+        
+        // Set the appropriate type based on T
+        request.set_type(typeName());
+        request.set_session_id(shard.session.id());
+        
+        memory_manager::CreateResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = shard.stub->Create(&context, request, &response);
+        
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to create memory block: " + status.error_message());
+        }
+        
+        shard.free_memory.store(response.free_memory());
+        if (!response.success()) {
+            throw std::runtime_error("Failed to create memory block: " + response.message());
+        }
+
+        // Create already counted this reference, so it's adopted without another RPC
+        shard.ledger.adopt(response.id());
+        pointer.id_ = encodeShardId(shard_index, response.id());
+        return pointer;
+    }
+
     // Proxy class to handle the dereference and assignment operations
     class ValueProxy {
     private:
@@ -46,32 +250,35 @@ private:
             if (pointer.id_ == -1) {
                 throw std::runtime_error("Invalid memory block ID");
             }
+            ShardConnection& shard = shardFor(pointer.id_);
+            int id = localId(pointer.id_);
+
+            std::string cached;
+            if (shard.cache.lookup(id, &cached)) {
+                return parseValue(cached);
+            }
+
+            // Same-host clients load the value straight from the shared chunk
+            T direct_value;
+            if (shard.shared_memory.enabled() &&
+                shard.shared_memory.read(id, typeName(), &direct_value, sizeof(T))) {
+                return direct_value;
+            }
+            uint64_t cache_version = shard.cache.version();
             
             memory_manager::GetRequest request;
-            request.set_id(pointer.id_);
+            request.set_id(id);
             
             memory_manager::GetResponse response;
             grpc::ClientContext context;
-            grpc::Status status = pointer.stub_->Get(&context, request, &response);
+            grpc::Status status = shard.stub->Get(&context, request, &response);
             
             if (!status.ok()) {
                 throw std::runtime_error("Failed to get value: " + status.error_message());
             }
             
-            std::string valueStr = response.value();
-            if (valueStr.find("No value assigned") != std::string::npos) {
-                return T(); // Default value
-            }
-            
-            if constexpr (std::is_same<T, int>::value) {
-                return std::stoi(valueStr);
-            } else if constexpr (std::is_same<T, float>::value) {
-                return std::stof(valueStr);
-            } else if constexpr (std::is_same<T, double>::value) {
-                return std::stod(valueStr);
-            } else {
-                throw std::runtime_error("Unsupported type for conversion");
-            }
+            shard.cache.fill(id, response.value(), cache_version);
+            return parseValue(response.value());
         }
         
         // Assignment operator to allow writing the value
@@ -79,25 +286,38 @@ private:
             if (pointer.id_ == -1) {
                 throw std::runtime_error("Invalid memory block ID");
             }
+            ShardConnection& shard = shardFor(pointer.id_);
+            int id = localId(pointer.id_);
             
             memory_manager::SetRequest request;
-            request.set_id(pointer.id_);
-            
-            if constexpr (std::is_same<T, int>::value || 
-                        std::is_same<T, float>::value || 
-                        std::is_same<T, double>::value) {
-                request.set_value(std::to_string(new_value));
-            } else {
-                throw std::runtime_error("Unsupported type for conversion");
+            request.set_id(id);
+            request.set_client_id(shard.cache.clientId());
+            request.set_value(formatValue(new_value));
+
+            // Write-back mode keeps the value until the cache flushes it
+            if (shard.cache.writeBack()) {
+                shard.cache.write(id, request.value());
+                return *this;
+            }
+
+            uint64_t version = shard.cache.version();
+            if (shard.shared_memory.enabled() &&
+                shard.shared_memory.write(id, typeName(), &new_value, sizeof(T))) {
+                shard.cache.update(id, request.value(), version);
+                return *this;
             }
             
             memory_manager::SetResponse response;
             grpc::ClientContext context;
-            grpc::Status status = pointer.stub_->Set(&context, request, &response);
+            grpc::Status status = shard.stub->Set(&context, request, &response);
             
             if (!status.ok()) {
                 throw std::runtime_error("Failed to set value: " + status.error_message());
             }
+
+            if (response.success()) {
+                shard.cache.update(id, request.value(), version);
+            }
             
             return *this;
         }
@@ -105,22 +325,21 @@ private:
 
 public:
     // Default constructor
-    MPointer() : id_(-1), next_id_(-1) {}
+    MPointer() : id_(-1) {}
     
     // Constructor with ID
-    explicit MPointer(int id) : id_(id), next_id_(-1) {
+    explicit MPointer(int id) : id_(id) {
         increaseRefCount();
     }
     
     // Copy constructor
-    MPointer(const MPointer& other) : id_(other.id_), next_id_(other.next_id_) {
+    MPointer(const MPointer& other) : id_(other.id_) {
         increaseRefCount();
     }
     
     // Move constructor
-    MPointer(MPointer&& other) noexcept : id_(other.id_), next_id_(other.next_id_) {
+    MPointer(MPointer&& other) noexcept : id_(other.id_) {
         other.id_ = -1;
-        other.next_id_ = -1;
     }
     
     // Copy assignment operator
@@ -128,7 +347,6 @@ public:
         if (this != &other) {  // This is comparing pointers, which is correct
             decreaseRefCount();
             id_ = other.id_;
-            next_id_ = other.next_id_;
             increaseRefCount();
         }
         return *this;
@@ -140,51 +358,319 @@ public:
         if (this != std::addressof(other)) {
             decreaseRefCount();
             id_ = other.id_;
-            next_id_ = other.next_id_;
             other.id_ = -1;
-            other.next_id_ = -1;
         }
         return *this;
     }
     
-    // Initialize stub
-    static void Init(const std::string& server_address) {
-        stub_ = memory_manager::MemoryManager::NewStub(
-            grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials())
-        );
+    // Initialize stub. server_address is host:port, or unix:/path/to/socket for a mem_mgr
+    // started with --unix on the same host. Released references are batched and flushed
+    // every flush_interval, or sooner once max_batch ids are waiting.
+    static void Init(const std::string& server_address,
+                     std::chrono::milliseconds flush_interval = std::chrono::milliseconds(50),
+                     size_t max_batch = 256) {
+        Init(std::vector<std::string>{server_address}, flush_interval, max_batch);
+    }
+
+    // Spread blocks over several servers. Each id remembers its server, so every
+    // operation on it goes to that server; New() places blocks on the least-loaded one.
+    // The order of addresses must be the same everywhere ids are shared.
+    static void Init(const std::vector<std::string>& server_addresses,
+                     std::chrono::milliseconds flush_interval = std::chrono::milliseconds(50),
+                     size_t max_batch = 256) {
+        if (server_addresses.empty() || server_addresses.size() > MAX_SHARDS) {
+            throw std::invalid_argument("MPointer needs between 1 and " + std::to_string(MAX_SHARDS) + " servers");
+        }
+        shards_.clear();
+        for (const std::string& address : server_addresses) {
+            shards_.push_back(std::make_unique<ShardConnection>(address, flush_interval, max_batch));
+        }
+    }
+
+    // Serve reads from a local cache kept fresh by the server's invalidation stream.
+    // Cached values are trusted for at most lease. With write_back, assignments are
+    // kept locally and only the latest value per id is sent every flush_interval.
+    static void EnableCache(std::chrono::milliseconds lease, bool write_back = false,
+                            std::chrono::milliseconds flush_interval = std::chrono::milliseconds(50)) {
+        if (shards_.empty()) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+        for (auto& shard : shards_) {
+            shard->cache.start(shard->newStub(), lease, write_back, flush_interval);
+        }
+    }
+
+    static void DisableCache() {
+        for (auto& shard : shards_) {
+            shard->cache.stop();
+        }
+    }
+
+    // Read (and with writable, write) blocks directly in the server's shared-memory
+    // chunk. Only works on the server's host and when mem_mgr runs with --shm; any
+    // block the fast path can't serve still goes through Get/Set. Direct writes don't
+    // reach other clients' caches.
+    static void EnableSharedMemory(bool writable = false) {
+        if (shards_.empty()) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+        for (auto& shard : shards_) {
+            shard->shared_memory.start(shard->newStub(), writable);
+        }
+    }
+
+    // Serve New() from a pool of blocks reserved batch at a time, refilled in the
+    // background once fewer than low_water are left. Pooled blocks of one batch are
+    // adjacent on the server. Blocks still pooled are released by DisablePool().
+    static void EnablePool(size_t batch = 256, size_t low_water = 64) {
+        if (shards_.empty()) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+        for (auto& shard : shards_) {
+            ensureTypeRegistered(*shard);
+            shard->pool.start(shard->newStub(), sizeof(T), typeName(), batch, low_water, &shard->free_memory,
+                              shard->session.id());
+        }
+    }
+
+    static void DisablePool() {
+        for (auto& shard : shards_) {
+            shard->releasePool();
+        }
+    }
+
+    // Create every later block in a session on each server. Closing it, or the process
+    // dying and its lease running out, frees them at once, except those other blocks
+    // or other processes still reference. quota_bytes 0 means no quota, a lease of 0
+    // the server's default. Open it before EnablePool() so pooled blocks are part of it.
+    static void OpenSession(uint64_t quota_bytes = 0, std::chrono::milliseconds lease = std::chrono::milliseconds(0)) {
+        if (shards_.empty()) {
+            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        }
+        for (auto& shard : shards_) {
+            shard->session.start(shard->newStub(), quota_bytes, lease);
+            shard->ledger.setSession(shard->session.id());
+        }
+    }
+
+    // Frees the session's blocks, pooled ones included. This process's MPointers to them
+    // dangle afterwards, even to blocks kept for other holders.
+    static void CloseSession() {
+        for (auto& shard : shards_) {
+            shard->releasePool();
+            shard->ledger.setSession("");
+            shard->session.stop();
+        }
+    }
+
+    // Send queued reference releases and write-back values without waiting for the next interval
+    static void Flush() {
+        for (auto& shard : shards_) {
+            shard->cache.flush();
+            shard->ledger.flush();
+        }
     }
     
     // Create a new memory block
     static MPointer<T> New() {
-        if (!stub_) {
-            throw std::runtime_error("MPointer not initialized. Call Init() first.");
+        return createOn(placeNewBlock());
+    }
+
+    // Create a new memory block on the same server as near, so the two can be linked
+    static MPointer<T> NewNear(const MPointer<T>& near) {
+        if (near.id_ == -1) {
+            return New();
         }
-        
+        shardFor(near.id_); // Throws for an id no configured server owns
+        return createOn(shardIndex(near.id_));
+    }
+
+    // Asynchronous variant of New(). Any number of these may be in flight at once;
+    // the future is completed from the completion-queue thread. A pooled block comes
+    // back as an already completed future.
+    static std::future<MPointer<T>> NewAsync() {
+        size_t shard_index = placeNewBlock();
+        ShardConnection* shard = shards_[shard_index].get();
+
+        int pooled_id;
+        if (shard->pool.pop(&pooled_id)) {
+            std::promise<MPointer<T>> ready;
+            MPointer<T> pointer;
+            shard->ledger.adopt(pooled_id);
+            pointer.id_ = encodeShardId(shard_index, pooled_id);
+            ready.set_value(std::move(pointer));
+            return ready.get_future();
+        }
+        ensureTypeRegistered(*shard);
+
         memory_manager::CreateRequest request;
         request.set_size(sizeof(T));
-        
-        // Set the appropriate type based on T
-        if (std::is_same<T, int>::value) {
-            request.set_type("int");
-        } else if (std::is_same<T, float>::value) {
-            request.set_type("float");
-        } else if (std::is_same<T, double>::value) {
-            request.set_type("double");
-        } else {
-            request.set_type("generic");
+        request.set_type(typeName());
+        request.set_session_id(shard->session.id());
+
+        auto promise = std::make_shared<std::promise<MPointer<T>>>();
+        std::future<MPointer<T>> future = promise->get_future();
+        shard->async.template call<memory_manager::CreateResponse>(
+            [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+                return stub->PrepareAsyncCreate(context, request, cq);
+            },
+            [promise, shard, shard_index](const grpc::Status& status, const memory_manager::CreateResponse& response) {
+                if (!status.ok() || !response.success()) {
+                    promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                        "Failed to create memory block: " + (status.ok() ? response.message() : status.error_message()))));
+                    return;
+                }
+                shard->free_memory.store(response.free_memory());
+                MPointer<T> pointer;
+                shard->ledger.adopt(response.id());
+                pointer.id_ = encodeShardId(shard_index, response.id());
+                promise->set_value(std::move(pointer));
+            });
+        return future;
+    }
+
+    // Asynchronous read. A cache hit returns an already completed future.
+    std::future<T> readAsync() const {
+        if (id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
         }
-        
-        memory_manager::CreateResponse response;
+        ShardConnection* shard = &shardFor(id_);
+        int id = localId(id_);
+
+        auto promise = std::make_shared<std::promise<T>>();
+        std::future<T> future = promise->get_future();
+
+        std::string cached;
+        if (shard->cache.lookup(id, &cached)) {
+            promise->set_value(parseValue(cached));
+            return future;
+        }
+        uint64_t cache_version = shard->cache.version();
+
+        memory_manager::GetRequest request;
+        request.set_id(id);
+        // The copy keeps the block referenced until the read completes
+        MPointer<T> self(*this);
+        shard->async.template call<memory_manager::GetResponse>(
+            [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+                return stub->PrepareAsyncGet(context, request, cq);
+            },
+            [promise, self, shard, id, cache_version](const grpc::Status& status, const memory_manager::GetResponse& response) {
+                if (!status.ok()) {
+                    promise->set_exception(std::make_exception_ptr(
+                        std::runtime_error("Failed to get value: " + status.error_message())));
+                    return;
+                }
+                try {
+                    shard->cache.fill(id, response.value(), cache_version);
+                    promise->set_value(parseValue(response.value()));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        return future;
+    }
+
+    // Asynchronous write. In write-back cache mode it completes immediately.
+    std::future<void> writeAsync(const T& new_value) {
+        if (id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
+        }
+        ShardConnection* shard = &shardFor(id_);
+        int id = localId(id_);
+
+        memory_manager::SetRequest request;
+        request.set_id(id);
+        request.set_client_id(shard->cache.clientId());
+        request.set_value(formatValue(new_value));
+
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> future = promise->get_future();
+        if (shard->cache.writeBack()) {
+            shard->cache.write(id, request.value());
+            promise->set_value();
+            return future;
+        }
+
+        MPointer<T> self(*this);
+        uint64_t version = shard->cache.version();
+        shard->async.template call<memory_manager::SetResponse>(
+            [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+                return stub->PrepareAsyncSet(context, request, cq);
+            },
+            [promise, self, shard, id, version, value = request.value()](const grpc::Status& status, const memory_manager::SetResponse& response) {
+                if (!status.ok() || !response.success()) {
+                    promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                        "Failed to set value: " + (status.ok() ? response.message() : status.error_message()))));
+                    return;
+                }
+                shard->cache.update(id, value, version);
+                promise->set_value();
+            });
+        return future;
+    }
+
+    // Atomically add delta on the server and return the previous value. One round
+    // trip, and concurrent adds from other clients are never lost.
+    T fetch_add(T delta) {
+        static_assert(isBuiltin && !std::is_same<T, bool>::value, "fetch_add needs a numeric type");
+        ShardConnection& shard = atomicShard();
+        int id = localId(id_);
+
+        memory_manager::FetchAddRequest request;
+        request.set_id(id);
+        request.set_delta(formatValue(delta));
+        request.set_client_id(shard.cache.clientId());
+
+        memory_manager::AtomicResponse response;
         grpc::ClientContext context;
-        grpc::Status status = stub_->Create(&context, request, &response);
-        
-        if (!status.ok()) {
-            throw std::runtime_error("Failed to create memory block: " + status.error_message());
+        uint64_t version = shard.cache.version();
+        grpc::Status status = shard.stub->FetchAdd(&context, request, &response);
+        finishAtomic(shard, id, "fetch_add", version, status, response);
+        return parseValue(response.previous());
+    }
+
+    // Store desired if the block still holds expected, like std::atomic. On failure
+    // expected is updated with the value the server holds, ready for a retry.
+    bool compare_exchange(T& expected, T desired) {
+        ShardConnection& shard = atomicShard();
+        int id = localId(id_);
+
+        memory_manager::CompareAndSwapRequest request;
+        request.set_id(id);
+        request.set_expected(formatValue(expected));
+        request.set_desired(formatValue(desired));
+        request.set_client_id(shard.cache.clientId());
+
+        memory_manager::AtomicResponse response;
+        grpc::ClientContext context;
+        uint64_t version = shard.cache.version();
+        grpc::Status status = shard.stub->CompareAndSwap(&context, request, &response);
+        finishAtomic(shard, id, "compare_exchange", version, status, response);
+        if (!response.exchanged()) {
+            expected = parseValue(response.current());
         }
-        
-        return MPointer<T>(response.id());
+        return response.exchanged();
     }
-    
+
+    // Atomically replace the value and return the previous one
+    T exchange(T new_value) {
+        ShardConnection& shard = atomicShard();
+        int id = localId(id_);
+
+        memory_manager::ExchangeRequest request;
+        request.set_id(id);
+        request.set_value(formatValue(new_value));
+        request.set_client_id(shard.cache.clientId());
+
+        memory_manager::AtomicResponse response;
+        grpc::ClientContext context;
+        uint64_t version = shard.cache.version();
+        grpc::Status status = shard.stub->Exchange(&context, request, &response);
+        finishAtomic(shard, id, "exchange", version, status, response);
+        return parseValue(response.previous());
+    }
+
     // The dereference operator now returns a proxy object
     ValueProxy operator*() {
         return ValueProxy(*this);
@@ -195,17 +681,47 @@ public:
         return id_;
     }
     
-    // Set the next pointer for linked list
+    // Set the next pointer for linked list. The link is stored in the block's first
+    // reference slot so the server's cycle collector can trace it. Both nodes must
+    // live on the same server.
     void setNext(const MPointer<T>& next) {
-        next_id_ = next.id_;  // Use the id_ directly
+        if (id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
+        }
+        if (next.id_ != -1 && shardIndex(next.id_) != shardIndex(id_)) {
+            throw std::runtime_error("Failed to set next pointer: nodes live on different servers");
+        }
+
+        memory_manager::ReferenceRequest request;
+        request.set_id(localId(id_));
+        request.set_slot(0);
+        request.set_target_id(next.id_ == -1 ? -1 : localId(next.id_));
+
+        memory_manager::ReferenceResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = shardFor(id_).stub->SetReference(&context, request, &response);
+
+        if (!status.ok() || !response.success()) {
+            throw std::runtime_error("Failed to set next pointer: " + (status.ok() ? response.message() : status.error_message()));
+        }
     }
     
-    // Get the next pointer
+    // Get the next pointer, as currently stored on the server
     MPointer<T> getNext() const {
-        if (next_id_ == -1) {
+        std::vector<std::pair<int, T>> path;
+        int next_id = streamList(1, &path);
+        if (next_id == -1) {
             return MPointer<T>();
         }
-        return MPointer<T>(next_id_);
+        return MPointer<T>(next_id);
+    }
+
+    // Walk the list starting at this node with a single streaming RPC. Returns the
+    // (id, value) of up to limit nodes (0 walks to the end or until a node repeats).
+    std::vector<std::pair<int, T>> traverse(int limit = 0) const {
+        std::vector<std::pair<int, T>> path;
+        streamList(limit, &path);
+        return path;
     }
     
     // Check if this is a null pointer
@@ -221,4 +737,7 @@ public:
 
 // Static member initialization
 template <typename T>
-std::unique_ptr<memory_manager::MemoryManager::Stub> MPointer<T>::stub_ = nullptr;
\ No newline at end of file
+std::vector<std::unique_ptr<ShardConnection>> MPointer<T>::shards_;
+
+template <typename T>
+std::atomic<size_t> MPointer<T>::next_shard_{0};
@@ -0,0 +1,135 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "proto/hello.grpc.pb.h"
+#include "MPointer.h"
+
+// Groups reads, compares and writes over several blocks into one Transact RPC that
+// the server applies all-or-nothing. Every block must live on the same server.
+//
+//     MTransaction tx;
+//     tx.compare(a, 1);
+//     tx.set(a, 2);
+//     tx.set(b, 3);
+//     size_t old_c = tx.read(c);
+//     if (tx.commit()) { int c_value = tx.result<int>(old_c); }
+class MTransaction {
+private:
+    struct Op {
+        ShardConnection* shard;
+        memory_manager::TransactOp op;
+    };
+
+    std::vector<Op> ops_;
+    std::vector<std::string> results_;
+    int failed_op_ = -1;
+    size_t reads_ = 0;
+
+    template <typename T>
+    void add(const MPointer<T>& pointer, memory_manager::TransactOp::Kind kind, const std::string& value = "") {
+        if (pointer.id_ == -1) {
+            throw std::runtime_error("Invalid memory block ID");
+        }
+        ShardConnection* shard = &MPointer<T>::shardFor(pointer.id_);
+        if (!ops_.empty() && shardIndex(pointer.id_) != shardIndex(ops_.front().op.id())) {
+            throw std::runtime_error("A transaction can't span blocks on different servers");
+        }
+
+        Op entry{shard, {}};
+        entry.op.set_kind(kind);
+        entry.op.set_id(pointer.id_); // Kept sharded until commit so the check above can use it
+        entry.op.set_value(value);
+        ops_.push_back(std::move(entry));
+    }
+
+public:
+    // Queue a read; the value is available from result() after a successful commit
+    template <typename T>
+    size_t read(const MPointer<T>& pointer) {
+        add(pointer, memory_manager::TransactOp::READ);
+        return reads_++;
+    }
+
+    // Abort the transaction unless the block holds expected
+    template <typename T>
+    void compare(const MPointer<T>& pointer, const T& expected) {
+        add(pointer, memory_manager::TransactOp::COMPARE, MPointer<T>::formatValue(expected));
+    }
+
+    template <typename T>
+    void set(const MPointer<T>& pointer, const T& value) {
+        add(pointer, memory_manager::TransactOp::SET, MPointer<T>::formatValue(value));
+    }
+
+    // Link pointer to next through the first reference slot, like MPointer::setNext
+    template <typename T>
+    void setNext(const MPointer<T>& pointer, const MPointer<T>& next) {
+        if (next.id_ != -1 && shardIndex(next.id_) != shardIndex(pointer.id_)) {
+            throw std::runtime_error("Failed to set next pointer: nodes live on different servers");
+        }
+        add(pointer, memory_manager::TransactOp::SET_REFERENCE);
+        ops_.back().op.set_slot(0);
+        ops_.back().op.set_target_id(next.id_ == -1 ? -1 : localId(next.id_));
+    }
+
+    // Send the transaction. Returns false when a compare didn't match or an operation
+    // was invalid, in which case nothing was changed; throws when the RPC fails.
+    // The queued operations are cleared once the server has answered.
+    bool commit() {
+        results_.clear();
+        failed_op_ = -1;
+        if (ops_.empty()) {
+            return true;
+        }
+
+        ShardConnection* shard = ops_.front().shard;
+        memory_manager::TransactRequest request;
+        request.set_client_id(shard->cache.clientId());
+        for (Op& entry : ops_) {
+            // Queued write-back values go first so the transaction sees them
+            if (entry.shard->cache.writeBack()) {
+                entry.shard->cache.flush();
+            }
+            memory_manager::TransactOp* op = request.add_ops();
+            *op = entry.op;
+            op->set_id(localId(entry.op.id()));
+        }
+
+        memory_manager::TransactResponse response;
+        grpc::ClientContext context;
+        uint64_t version = shard->cache.version();
+        grpc::Status status = shard->stub->Transact(&context, request, &response);
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to commit transaction: " + status.error_message());
+        }
+
+        failed_op_ = response.failed_op();
+        if (response.success()) {
+            results_.assign(response.values().begin(), response.values().end());
+            for (const Op& entry : ops_) {
+                if (entry.op.kind() == memory_manager::TransactOp::SET) {
+                    shard->cache.update(localId(entry.op.id()), entry.op.value(), version);
+                }
+            }
+        }
+        ops_.clear();
+        reads_ = 0;
+        return response.success();
+    }
+
+    // Value of the index-th read of the last committed transaction
+    template <typename T>
+    T result(size_t index) const {
+        if (index >= results_.size()) {
+            throw std::out_of_range("No transaction read at index " + std::to_string(index));
+        }
+        return MPointer<T>::parseValue(results_[index]);
+    }
+
+    // Index of the operation that aborted the last commit, or -1
+    int failedOp() const {
+        return failed_op_;
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdexcept>
+#include "MPointer.h"
+
+// A reference to an MPointer's block that doesn't keep it alive. Taking, copying
+// and dropping one is purely local: no ref-count RPC, and the GC may reclaim the
+// block once only weak pointers are left. lock() turns it back into a strong
+// MPointer, with a single check-and-increment RPC unless this process already holds
+// the block. Meant for caches, back-pointers and debug views.
+template <typename T>
+class MWeakPointer {
+private:
+    int id_ = -1;
+
+public:
+    MWeakPointer() = default;
+
+    MWeakPointer(const MPointer<T>& pointer) : id_(pointer.id_) {}
+
+    MWeakPointer& operator=(const MPointer<T>& pointer) {
+        id_ = pointer.id_;
+        return *this;
+    }
+
+    // A strong pointer to the block, or a null one if it has been released
+    MPointer<T> lock() const {
+        MPointer<T> pointer;
+        if (id_ != -1 && MPointer<T>::shardFor(id_).ledger.tryAcquire(localId(id_))) {
+            pointer.id_ = id_;
+        }
+        return pointer;
+    }
+
+    // Whether the block is gone. Asks the server like lock() does, so use lock()
+    // directly when the pointer is needed anyway.
+    bool expired() const {
+        return lock().isNull();
+    }
+
+    void reset() {
+        id_ = -1;
+    }
+
+    bool isNull() const {
+        return id_ == -1;
+    }
+
+    int getId() const {
+        return id_;
+    }
+};
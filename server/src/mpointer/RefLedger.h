@@ -0,0 +1,254 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "proto/hello.grpc.pb.h"
+
+// Client-side reference ledger shared by every MPointer of one type.
+// The process holds a single server reference per id while any local MPointer
+// points at it; copies only touch the local count. Taking the first local
+// reference is sent right away so the block can't be freed under us, while
+// dropping the last one is queued and sent later as a batched net delta. A
+// queued release is cancelled if the id is picked up again before the flush.
+// Requests carry the client's session, so the server knows when the creator of a
+// session block has let go of it. No RPC is sent with the lock held: an id whose
+// increase is in flight is marked, and other threads taking it wait for the answer.
+class RefLedger {
+private:
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    std::unordered_map<int, int> local_counts_;
+    std::unordered_map<int, int> pending_deltas_;
+    std::unordered_set<int> increasing_; // Ids whose first reference is being sent
+    std::string session_id_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable increased_cv_;
+    std::thread flush_thread_;
+    bool should_stop_ = false;
+
+    std::chrono::milliseconds flush_interval_{50};
+    size_t max_batch_ = 256;
+
+    // Throws when the RPC fails or the block doesn't exist
+    void sendIncrease(int id, const std::string& session_id) {
+        memory_manager::RefCountRequest request;
+        request.set_id(id);
+        request.set_session_id(session_id);
+        memory_manager::RefCountResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->IncreaseRefCount(&context, request, &response);
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to increase reference count: " + status.error_message());
+        }
+        if (!response.success() || response.new_ref_count() == -1) {
+            throw std::runtime_error("Failed to increase reference count: block " + std::to_string(id) +
+                                     " doesn't exist");
+        }
+    }
+
+    // Sends the queued deltas. Errors are dropped: a lost release only delays freeing.
+    void sendBatch(std::unordered_map<int, int> deltas, const std::string& session_id) {
+        memory_manager::RefCountBatchRequest request;
+        request.set_session_id(session_id);
+        for (const auto& [id, delta] : deltas) {
+            if (delta != 0) {
+                auto* entry = request.add_deltas();
+                entry->set_id(id);
+                entry->set_delta(delta);
+            }
+        }
+        if (request.deltas_size() == 0) {
+            return;
+        }
+
+        memory_manager::RefCountBatchResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->UpdateRefCounts(&context, request, &response);
+        if (!status.ok()) {
+            std::cerr << "Failed to flush reference counts: " << status.error_message() << std::endl;
+        }
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!should_stop_) {
+            cv_.wait_for(lock, flush_interval_, [this] {
+                return should_stop_ || pending_deltas_.size() >= max_batch_;
+            });
+            std::unordered_map<int, int> batch;
+            batch.swap(pending_deltas_);
+            std::string session_id = session_id_;
+            lock.unlock();
+            sendBatch(std::move(batch), session_id);
+            lock.lock();
+        }
+    }
+
+public:
+    RefLedger() = default;
+    RefLedger(const RefLedger&) = delete;
+    RefLedger& operator=(const RefLedger&) = delete;
+
+    ~RefLedger() {
+        stop();
+    }
+
+    // Connects the ledger and starts the background flush
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub,
+               std::chrono::milliseconds flush_interval, size_t max_batch) {
+        stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stub_ = std::move(stub);
+        flush_interval_ = flush_interval;
+        max_batch_ = max_batch;
+        should_stop_ = false;
+        flush_thread_ = std::thread(&RefLedger::flushLoop, this);
+    }
+
+    // Stops the flush thread after sending whatever is still queued
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            should_stop_ = true;
+        }
+        cv_.notify_one();
+        if (flush_thread_.joinable()) {
+            flush_thread_.join();
+        }
+        if (stub_) {
+            std::unordered_map<int, int> batch;
+            std::string session_id;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                batch.swap(pending_deltas_);
+                session_id = session_id_;
+            }
+            sendBatch(std::move(batch), session_id);
+        }
+    }
+
+    // Session the client's new blocks belong to, empty for none
+    void setSession(const std::string& session_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session_id_ = session_id;
+    }
+
+    // Takes a local reference, sending the increase only if this is the first one
+    void acquire(int id) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        increased_cv_.wait(lock, [this, id] { return increasing_.count(id) == 0; });
+        if (local_counts_[id]++ > 0) {
+            return;
+        }
+        auto pending = pending_deltas_.find(id);
+        if (pending != pending_deltas_.end() && pending->second < 0) {
+            // Still holding the server reference whose release is queued
+            pending->second++;
+            return;
+        }
+
+        increasing_.insert(id);
+        std::string session_id = session_id_;
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            sendIncrease(id, session_id);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        increasing_.erase(id);
+        if (error) {
+            local_counts_.erase(id); // Everyone else taking it waited, so this was the only one
+        }
+        lock.unlock();
+        increased_cv_.notify_all();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Takes a local reference to an id only known weakly. Without one already held,
+    // the server is asked to count a reference only if the block is still alive.
+    // Returns false, taking nothing, when it isn't.
+    bool tryAcquire(int id) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        increased_cv_.wait(lock, [this, id] { return increasing_.count(id) == 0; });
+        auto local = local_counts_.find(id);
+        if (local != local_counts_.end()) {
+            local->second++;
+            return true;
+        }
+        auto pending = pending_deltas_.find(id);
+        if (pending != pending_deltas_.end() && pending->second < 0) {
+            // Still holding the server reference whose release is queued
+            pending->second++;
+            local_counts_[id] = 1;
+            return true;
+        }
+
+        memory_manager::RefCountRequest request;
+        request.set_id(id);
+        request.set_session_id(session_id_);
+        increasing_.insert(id);
+        lock.unlock();
+        memory_manager::RefCountResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->TryIncreaseRefCount(&context, request, &response);
+        lock.lock();
+        increasing_.erase(id);
+        bool acquired = status.ok() && response.success();
+        if (acquired) {
+            local_counts_[id] = 1;
+        }
+        lock.unlock();
+        increased_cv_.notify_all();
+        if (!status.ok()) {
+            throw std::runtime_error("Failed to increase reference count: " + status.error_message());
+        }
+        return acquired;
+    }
+
+    // Takes over the reference a Create RPC already counted for us
+    void adopt(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (local_counts_[id]++ > 0) {
+            pending_deltas_[id]--; // Already holding one, give the extra back
+        }
+    }
+
+    // Drops a local reference; the last one queues a server release
+    void release(int id) {
+        bool flush_now = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = local_counts_.find(id);
+            if (it == local_counts_.end()) {
+                return;
+            }
+            if (--it->second > 0) {
+                return;
+            }
+            local_counts_.erase(it);
+            pending_deltas_[id]--;
+            flush_now = pending_deltas_.size() >= max_batch_;
+        }
+        if (flush_now) {
+            cv_.notify_one();
+        }
+    }
+
+    // Wakes the flush thread so queued releases go out now
+    void flush() {
+        cv_.notify_one();
+    }
+};
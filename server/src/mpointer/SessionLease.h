@@ -0,0 +1,113 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "proto/hello.grpc.pb.h"
+
+// A server session the client's new blocks belong to. A background thread renews
+// its lease; if the process dies without closing it, the server releases every
+// block of the session once the lease runs out.
+class SessionLease {
+private:
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    std::string session_id_;
+    std::chrono::milliseconds lease_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread renew_thread_;
+    bool should_stop_ = false;
+
+    void renewLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!should_stop_) {
+            // A third of the lease leaves room for two failed renewals
+            auto period = std::max(lease_ / 3, std::chrono::milliseconds(1));
+            if (cv_.wait_for(lock, period, [this] { return should_stop_; })) {
+                break;
+            }
+
+            memory_manager::SessionRequest request;
+            request.set_session_id(session_id_);
+            lock.unlock();
+            memory_manager::SessionResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub_->RenewSession(&context, request, &response);
+            lock.lock();
+            if (status.ok() && !response.success()) {
+                std::cerr << "Session " << session_id_ << " expired on the server" << std::endl;
+                session_id_.clear();
+                break;
+            }
+        }
+    }
+
+public:
+    SessionLease() = default;
+    SessionLease(const SessionLease&) = delete;
+    SessionLease& operator=(const SessionLease&) = delete;
+
+    ~SessionLease() {
+        stop();
+    }
+
+    // Opens the session. quota_bytes 0 means no quota, a lease of 0 the server's default.
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub, uint64_t quota_bytes,
+               std::chrono::milliseconds lease) {
+        stop();
+
+        memory_manager::OpenSessionRequest request;
+        request.set_quota_bytes(quota_bytes);
+        request.set_lease_ms(static_cast<int32_t>(lease.count()));
+        memory_manager::SessionResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub->OpenSession(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            throw std::runtime_error("Failed to open session: " +
+                                     (status.ok() ? response.message() : status.error_message()));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stub_ = std::move(stub);
+        session_id_ = response.session_id();
+        lease_ = std::chrono::milliseconds(response.lease_ms());
+        should_stop_ = false;
+        renew_thread_ = std::thread(&SessionLease::renewLoop, this);
+    }
+
+    // Closes the session, which frees all its blocks on the server. Returns how many.
+    int stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            should_stop_ = true;
+        }
+        cv_.notify_one();
+        if (renew_thread_.joinable()) {
+            renew_thread_.join();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (session_id_.empty()) {
+            return 0;
+        }
+        memory_manager::SessionRequest request;
+        request.set_session_id(session_id_);
+        memory_manager::SessionResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->CloseSession(&context, request, &response);
+        session_id_.clear();
+        return status.ok() ? response.released() : 0;
+    }
+
+    // Empty when no session is open
+    std::string id() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return session_id_;
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "proto/hello.grpc.pb.h"
+#include "RefLedger.h"
+#include "ValueCache.h"
+#include "AsyncClient.h"
+#include "SharedMemoryView.h"
+#include "BlockPool.h"
+#include "SessionLease.h"
+
+// Ids handed out by MPointer carry the index of the owning server in their top
+// bits; the low SHARD_ID_BITS are the id that server assigned. Shard 0 ids are
+// exactly the server's ids, so a single-server setup sees no difference.
+constexpr int SHARD_ID_BITS = 24;
+constexpr size_t MAX_SHARDS = 127;
+
+inline int encodeShardId(size_t shard, int local_id) {
+    if (local_id < 0 || local_id >= (1 << SHARD_ID_BITS)) {
+        throw std::runtime_error("Server id " + std::to_string(local_id) + " doesn't fit in a sharded id");
+    }
+    return static_cast<int>(shard << SHARD_ID_BITS) | local_id;
+}
+
+inline size_t shardIndex(int id) {
+    return static_cast<size_t>(id) >> SHARD_ID_BITS;
+}
+
+inline int localId(int id) {
+    return id & ((1 << SHARD_ID_BITS) - 1);
+}
+
+// One mem_mgr server and all the client-side state MPointer keeps for it.
+// Everything inside works with that server's own (local) ids.
+struct ShardConnection {
+    std::shared_ptr<grpc::Channel> channel;
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub;
+    RefLedger ledger;
+    ValueCache cache;
+    AsyncClient async;
+    SharedMemoryView shared_memory;
+    BlockPool pool;
+    SessionLease session;
+
+    // Free bytes the server reported on the last Create, used to place new blocks
+    std::atomic<uint64_t> free_memory{std::numeric_limits<uint64_t>::max()};
+
+    // Set once the pointer type's TypeCodec layout is registered with this server
+    std::atomic<bool> type_registered{false};
+
+    ShardConnection(const std::string& address, std::chrono::milliseconds flush_interval, size_t max_batch)
+        : channel(grpc::CreateChannel(address, grpc::InsecureChannelCredentials())),
+          stub(memory_manager::MemoryManager::NewStub(channel)) {
+        ledger.start(memory_manager::MemoryManager::NewStub(channel), flush_interval, max_batch);
+        async.start(memory_manager::MemoryManager::NewStub(channel));
+    }
+
+    // Closing the session frees whatever blocks of it are left
+    ~ShardConnection() {
+        releasePool();
+        session.stop();
+    }
+
+    // Stops the block pool and queues the release of every block it still held
+    void releasePool() {
+        for (int id : pool.stop()) {
+            ledger.adopt(id);
+            ledger.release(id);
+        }
+    }
+
+    std::unique_ptr<memory_manager::MemoryManager::Stub> newStub() const {
+        return memory_manager::MemoryManager::NewStub(channel);
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "proto/hello.grpc.pb.h"
+#include "shared_memory/shm_layout.h"
+
+// Direct loads and stores into a mem_mgr chunk exported with --shm, for clients
+// on the same host. Block offsets come from the Locate RPC and are cached
+// together with the segment sequence they were valid for; a changed sequence
+// means the server compacted and the offset is looked up again. Whenever the
+// fast path can't be used, read()/write() return false and the caller falls
+// back to Get/Set. Direct stores bypass the server, so they don't trigger cache
+// invalidations for other clients.
+class SharedMemoryView {
+private:
+    struct Location {
+        uint64_t offset;
+        size_t size;
+        std::string type;
+        uint64_t sequence;
+    };
+
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    void* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    bool writable_ = false;
+    std::unordered_map<int, Location> locations_;
+    std::mutex mutex_;
+
+    static constexpr int MAX_ATTEMPTS = 3;
+
+    ShmHeader* header() const {
+        return static_cast<ShmHeader*>(base_);
+    }
+
+    char* data() const {
+        return static_cast<char*>(base_) + SHM_HEADER_SIZE;
+    }
+
+    void map(const std::string& shm_name) {
+        int fd = shm_open(shm_name.c_str(), writable_ ? O_RDWR : O_RDONLY, 0);
+        if (fd == -1) {
+            throw std::runtime_error("Failed to open shared memory " + shm_name);
+        }
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            close(fd);
+            throw std::runtime_error("Failed to stat shared memory " + shm_name);
+        }
+        void* base = mmap(nullptr, static_cast<size_t>(info.st_size),
+                          writable_ ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("Failed to map shared memory " + shm_name);
+        }
+        base_ = base;
+        mapped_size_ = static_cast<size_t>(info.st_size);
+    }
+
+    // Cached location of id, asking the server when missing or stale
+    bool locate(int id, uint64_t current_sequence, Location& location) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = locations_.find(id);
+            if (it != locations_.end() && it->second.sequence == current_sequence) {
+                location = it->second;
+                return true;
+            }
+        }
+
+        memory_manager::LocateRequest request;
+        request.set_id(id);
+        memory_manager::LocateResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub_->Locate(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (base_ == nullptr) {
+            map(response.shm_name());
+        }
+        location = {response.offset(), response.size(), response.type(), response.sequence()};
+        if (location.offset + location.size > mapped_size_ - SHM_HEADER_SIZE) {
+            return false;
+        }
+        locations_[id] = location;
+        return true;
+    }
+
+public:
+    SharedMemoryView() = default;
+    SharedMemoryView(const SharedMemoryView&) = delete;
+    SharedMemoryView& operator=(const SharedMemoryView&) = delete;
+
+    ~SharedMemoryView() {
+        stop();
+    }
+
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub, bool writable) {
+        stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stub_ = std::move(stub);
+        writable_ = writable;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (base_ != nullptr) {
+            munmap(base_, mapped_size_);
+            base_ = nullptr;
+        }
+        stub_.reset();
+        locations_.clear();
+    }
+
+    bool enabled() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stub_ != nullptr;
+    }
+
+    // Copies the block into out if it has the given type and size
+    bool read(int id, const std::string& type, void* out, size_t size) {
+        for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            uint64_t before = base_ != nullptr ? header()->sequence.load() : 0;
+            if (before % 2 == 1) {
+                std::this_thread::yield(); // Server is compacting
+                continue;
+            }
+
+            Location location;
+            if (!locate(id, before, location) || location.type != type || location.size != size) {
+                return false;
+            }
+            if (location.sequence != before) {
+                continue; // The server moved blocks meanwhile
+            }
+
+            std::memcpy(out, data() + location.offset, size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header()->sequence.load() == before) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Stores in into the block if the view is writable and the block has the given type and size
+    bool write(int id, const std::string& type, const void* in, size_t size) {
+        if (!writable_) {
+            return false;
+        }
+
+        for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            uint64_t before = base_ != nullptr ? header()->sequence.load() : 0;
+            Location location;
+            if (!locate(id, before, location) || location.type != type || location.size != size) {
+                return false;
+            }
+
+            // Registered first, then the sequence is checked: either the server sees the
+            // writer and waits, or we see its odd sequence and back off
+            header()->active_writers.fetch_add(1);
+            if (header()->sequence.load() == location.sequence && location.sequence % 2 == 0) {
+                std::memcpy(data() + location.offset, in, size);
+                header()->active_writers.fetch_sub(1);
+                return true;
+            }
+            header()->active_writers.fetch_sub(1);
+            std::this_thread::yield();
+        }
+        return false;
+    }
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+// How MPointer<T> moves a T that isn't one of the server's builtin types: as its
+// raw bytes, one memcpy each way, in blocks of a type registered with the server.
+// Derived for any trivially copyable T. The default name comes from typeid, which
+// only matches between clients built by the same compiler, so types shared more
+// widely should be named with MPOINTER_TYPE_NAME:
+//
+//     struct Point { double x, y; };
+//     MPOINTER_TYPE_NAME(Point, "Point")
+template <typename T>
+struct TypeCodec {
+    static_assert(std::is_trivially_copyable<T>::value, "MPointer<T> needs a trivially copyable T");
+
+    static constexpr size_t size = sizeof(T);
+    static constexpr size_t alignment = alignof(T);
+
+    static std::string name() {
+        return std::string("raw:") + typeid(T).name();
+    }
+
+    static std::string encode(const T& value) {
+        return std::string(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static T decode(const std::string& bytes) {
+        if (bytes.size() != sizeof(T)) {
+            throw std::runtime_error("Expected " + std::to_string(sizeof(T)) + " bytes for " + name() +
+                                     ", got " + std::to_string(bytes.size()));
+        }
+        T value;
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        return value;
+    }
+};
+
+#define MPOINTER_TYPE_NAME(Type, Name) \
+    template <>                        \
+    inline std::string TypeCodec<Type>::name() { return Name; }
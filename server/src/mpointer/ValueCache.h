@@ -0,0 +1,264 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "proto/hello.grpc.pb.h"
+
+// Optional client-side cache of block values, kept in their wire (string) form.
+// Entries are only served while the invalidation stream from the server is up,
+// and never past their lease, so a lost invalidation can't keep a stale value
+// around for longer than one lease. In write-back mode assignments stay local
+// and repeated writes to an id are coalesced into one Set per flush interval.
+class ValueCache {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string value;
+        Clock::time_point expires;
+        bool dirty;
+    };
+
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub_;
+    std::string client_id_;
+    std::unordered_map<int, Entry> entries_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread subscriber_thread_;
+    std::thread flush_thread_;
+    grpc::ClientContext* stream_context_ = nullptr;
+
+    bool enabled_ = false;
+    bool connected_ = false;
+    bool write_back_ = false;
+    bool should_stop_ = false;
+    // Bumped on every invalidation message, so a Get that raced with one isn't cached
+    uint64_t version_ = 0;
+    std::chrono::milliseconds lease_{0};
+    std::chrono::milliseconds flush_interval_{0};
+
+    static std::string newClientId() {
+        std::random_device random;
+        std::ostringstream oss;
+        oss << "client-" << std::hex << random() << random();
+        return oss.str();
+    }
+
+    // Keeps unflushed writes, drops everything that came from the server
+    void dropCleanEntries() {
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            it = it->second.dirty ? std::next(it) : entries_.erase(it);
+        }
+    }
+
+    void subscriberLoop() {
+        memory_manager::SubscribeRequest request;
+        request.set_client_id(client_id_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!should_stop_) {
+            grpc::ClientContext context;
+            stream_context_ = &context;
+            lock.unlock();
+
+            auto reader = stub_->Subscribe(&context, request);
+            memory_manager::Invalidation invalidation;
+            while (reader->Read(&invalidation)) {
+                std::lock_guard<std::mutex> guard(mutex_);
+                connected_ = true;
+                version_++;
+                for (int id : invalidation.ids()) {
+                    auto it = entries_.find(id);
+                    if (it != entries_.end() && !it->second.dirty) {
+                        entries_.erase(it);
+                    }
+                }
+            }
+            reader->Finish();
+
+            lock.lock();
+            stream_context_ = nullptr;
+            connected_ = false;
+            version_++;
+            dropCleanEntries();
+            // Retry the subscription after a pause, reads go to the server meanwhile
+            cv_.wait_for(lock, std::chrono::seconds(1), [this] { return should_stop_; });
+        }
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!should_stop_) {
+            cv_.wait_for(lock, flush_interval_, [this] { return should_stop_; });
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+public:
+    ValueCache() = default;
+    ValueCache(const ValueCache&) = delete;
+    ValueCache& operator=(const ValueCache&) = delete;
+
+    ~ValueCache() {
+        stop();
+    }
+
+    void start(std::unique_ptr<memory_manager::MemoryManager::Stub> stub, std::chrono::milliseconds lease,
+               bool write_back, std::chrono::milliseconds flush_interval) {
+        stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stub_ = std::move(stub);
+        client_id_ = newClientId();
+        lease_ = lease;
+        write_back_ = write_back;
+        flush_interval_ = flush_interval;
+        should_stop_ = false;
+        enabled_ = true;
+        subscriber_thread_ = std::thread(&ValueCache::subscriberLoop, this);
+        if (write_back_) {
+            flush_thread_ = std::thread(&ValueCache::flushLoop, this);
+        }
+    }
+
+    // Writes back what is still dirty and turns the cache off
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            should_stop_ = true;
+            if (stream_context_ != nullptr) {
+                stream_context_->TryCancel();
+            }
+        }
+        cv_.notify_all();
+        if (subscriber_thread_.joinable()) {
+            subscriber_thread_.join();
+        }
+        if (flush_thread_.joinable()) {
+            flush_thread_.join();
+        }
+        flush();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_ = false;
+        entries_.clear();
+    }
+
+    bool writeBack() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return enabled_ && write_back_;
+    }
+
+    // Id sent with Sets so the server doesn't invalidate our own copy
+    std::string clientId() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return enabled_ ? client_id_ : std::string();
+    }
+
+    // Taken before a Get or a write and handed back to fill() or update()
+    uint64_t version() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return version_;
+    }
+
+    bool lookup(int id, std::string* value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(id);
+        if (it == entries_.end()) {
+            return false;
+        }
+        if (!it->second.dirty && (!connected_ || Clock::now() >= it->second.expires)) {
+            entries_.erase(it);
+            return false;
+        }
+        *value = it->second.value;
+        return true;
+    }
+
+    // Caches a value read from the server unless an invalidation arrived since version
+    void fill(int id, const std::string& value, uint64_t version) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || !connected_ || version != version_) {
+            return;
+        }
+        auto& entry = entries_[id];
+        if (!entry.dirty) {
+            entry = {value, Clock::now() + lease_, false};
+        }
+    }
+
+    // Write-through: remember a value we just Set successfully, unless an invalidation
+    // arrived since version. It may be for another client's write that landed after
+    // ours, so the id's copy is dropped instead.
+    void update(int id, const std::string& value, uint64_t version) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || !connected_) {
+            return;
+        }
+        if (version != version_) {
+            auto it = entries_.find(id);
+            if (it != entries_.end() && !it->second.dirty) {
+                entries_.erase(it);
+            }
+            return;
+        }
+        entries_[id] = {value, Clock::now() + lease_, false};
+    }
+
+    // Write-back: keep the value locally until the next flush
+    void write(int id, const std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[id] = {value, Clock::now() + lease_, true};
+    }
+
+    // Sends every dirty value with one Set per id
+    void flush() {
+        std::vector<std::pair<int, std::string>> dirty;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!stub_) {
+                return;
+            }
+            for (auto& [id, entry] : entries_) {
+                if (entry.dirty) {
+                    dirty.emplace_back(id, entry.value);
+                    entry.dirty = false;
+                }
+            }
+        }
+
+        for (const auto& [id, value] : dirty) {
+            memory_manager::SetRequest request;
+            request.set_id(id);
+            request.set_value(value);
+            request.set_client_id(client_id_);
+
+            memory_manager::SetResponse response;
+            grpc::ClientContext context;
+            grpc::Status status = stub_->Set(&context, request, &response);
+            if (!status.ok()) {
+                // Mark it dirty again unless a newer write already replaced it
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = entries_.find(id);
+                if (it != entries_.end() && it->second.value == value) {
+                    it->second.dirty = true;
+                }
+                std::cerr << "Failed to write back ID " << id << ": " << status.error_message() << std::endl;
+            } else if (!response.success()) {
+                std::cerr << "Failed to write back ID " << id << ": " << response.message() << std::endl;
+            }
+        }
+    }
+};
@@ -1,66 +1,157 @@
 #include "parsing.h"
-#include <sstream>
-#include <algorithm>
+#include <cctype>
+#include <charconv>
 
-std::pair<std::string, std::vector<std::string>> CommandParser::parseCommand(const std::string& input) {
+namespace {
+
+std::string_view trim(std::string_view text) {
+    size_t first = 0;
+    while (first < text.size() && std::isspace(static_cast<unsigned char>(text[first]))) {
+        ++first;
+    }
+    size_t last = text.size();
+    while (last > first && std::isspace(static_cast<unsigned char>(text[last - 1]))) {
+        --last;
+    }
+    return text.substr(first, last - first);
+}
+
+} // namespace
+
+std::pair<std::string_view, std::vector<std::string_view>> CommandParser::parseCommand(std::string_view input) {
+    std::vector<std::string_view> args;
+    std::string_view command = parseCommand(input, args);
+    return {command, std::move(args)};
+}
+
+std::string_view CommandParser::parseCommand(std::string_view input, std::vector<std::string_view>& args) {
     // Find the opening and closing parentheses
     size_t open_paren = input.find('(');
     size_t close_paren = input.find(')');
 
-    if (open_paren == std::string::npos || close_paren == std::string::npos || close_paren <= open_paren) {
+    if (open_paren == std::string_view::npos || close_paren == std::string_view::npos || close_paren <= open_paren) {
         throw std::invalid_argument("Invalid command format. Expected format: command(arg1,arg2,...)");
     }
 
     // Extract the command name
-    std::string command = input.substr(0, open_paren);
-    command.erase(std::remove_if(command.begin(), command.end(), ::isspace), command.end()); // Remove spaces
+    std::string_view command = trim(input.substr(0, open_paren));
 
-    // Extract the arguments
-    std::string args_str = input.substr(open_paren + 1, close_paren - open_paren - 1);
-    std::vector<std::string> args;
-    std::stringstream ss(args_str);
-    std::string arg;
-
-    while (std::getline(ss, arg, ',')) {
-        arg.erase(std::remove_if(arg.begin(), arg.end(), ::isspace), arg.end()); // Remove spaces
-        args.push_back(arg);
+    // Extract the arguments; "f()" has none and "f(,)" has two empty ones
+    std::string_view args_str = input.substr(open_paren + 1, close_paren - open_paren - 1);
+    args.clear();
+    if (!trim(args_str).empty()) {
+        size_t start = 0;
+        while (true) {
+            size_t comma = args_str.find(',', start);
+            args.push_back(trim(args_str.substr(start, comma - start)));
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
     }
 
-    return {command, args};
+    return command;
+}
+
+int CommandParser::parseInt(std::string_view text) {
+    // from_chars doesn't take the leading '+' std::stoi did
+    std::string_view digits = text;
+    if (digits.size() > 1 && digits[0] == '+' && digits[1] != '-') {
+        digits.remove_prefix(1);
+    }
+    int value = 0;
+    auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (error == std::errc::result_out_of_range) {
+        throw std::out_of_range("Number out of range: " + std::string(text));
+    }
+    if (error != std::errc() || end != digits.data() + digits.size()) {
+        throw std::invalid_argument("Expected a number, got: " + std::string(text));
+    }
+    return value;
 }
 
-std::pair<int, std::string> CommandParser::parseCreate(const std::vector<std::string>& args) {
+std::pair<int, std::string_view> CommandParser::parseCreate(const std::vector<std::string_view>& args) {
     if (args.size() != 2) {
         throw std::invalid_argument("Invalid arguments for create. Expected: create(size,type)");
     }
 
-    int size = std::stoi(args[0]);
-    std::string type = args[1];
+    int size = parseInt(args[0]);
+    std::string_view type = args[1];
     return {size, type};
 }
 
-std::pair<int, std::string> CommandParser::parseSet(const std::vector<std::string>& args) {
+std::pair<int, std::string_view> CommandParser::parseSet(const std::vector<std::string_view>& args) {
     if (args.size() != 2) {
         throw std::invalid_argument("Invalid arguments for set. Expected: set(id,value)");
     }
 
-    int id = std::stoi(args[0]);
-    std::string value = args[1];
+    int id = parseInt(args[0]);
+    std::string_view value = args[1];
     return {id, value};
 }
 
-int CommandParser::parseGet(const std::vector<std::string>& args) {
+int CommandParser::parseGet(const std::vector<std::string_view>& args) {
     if (args.size() != 1) {
         throw std::invalid_argument("Invalid arguments for get. Expected: get(id)");
     }
 
-    return std::stoi(args[0]);
+    return parseInt(args[0]);
 }
 
-int CommandParser::parseRefCount(const std::vector<std::string>& args) {
+int CommandParser::parseRefCount(const std::vector<std::string_view>& args) {
     if (args.size() != 1) {
         throw std::invalid_argument("Invalid arguments for refCount. Expected: refCount(id)");
     }
 
-    return std::stoi(args[0]);
-}
\ No newline at end of file
+    return parseInt(args[0]);
+}
+
+std::tuple<int, int, int> CommandParser::parseSetReference(const std::vector<std::string_view>& args) {
+    if (args.size() != 3) {
+        throw std::invalid_argument("Invalid arguments for setReference. Expected: setReference(id,slot,target_id)");
+    }
+
+    return {parseInt(args[0]), parseInt(args[1]), parseInt(args[2])};
+}
+
+std::pair<int, int> CommandParser::parseTraverse(const std::vector<std::string_view>& args) {
+    if (args.empty() || args.size() > 2) {
+        throw std::invalid_argument("Invalid arguments for traverse. Expected: traverse(head_id[,limit])");
+    }
+
+    int limit = args.size() == 2 ? parseInt(args[1]) : 0;
+    return {parseInt(args[0]), limit};
+}
+
+int CommandParser::parseBenchmark(const std::vector<std::string_view>& args) {
+    if (args.size() != 1 || parseInt(args[0]) <= 0) {
+        throw std::invalid_argument("Invalid arguments for benchmark. Expected: benchmark(iterations)");
+    }
+
+    return parseInt(args[0]);
+}
+
+std::pair<int, int> CommandParser::parseRefBenchmark(const std::vector<std::string_view>& args) {
+    if (args.size() != 2 || parseInt(args[0]) <= 0 || parseInt(args[1]) <= 0) {
+        throw std::invalid_argument("Invalid arguments for refbench. Expected: refbench(threads,iterations)");
+    }
+
+    return {parseInt(args[0]), parseInt(args[1])};
+}
+
+std::string_view CommandParser::parseTarget(const std::vector<std::string_view>& args) {
+    if (args.size() != 1 || args[0].empty()) {
+        throw std::invalid_argument("Invalid arguments for export. Expected: export(file)");
+    }
+
+    return args[0];
+}
+
+std::pair<std::string_view, std::string_view> CommandParser::parseImport(const std::vector<std::string_view>& args) {
+    if (args.empty() || args.size() > 2 || args[0].empty() || (args.size() == 2 && args[1].empty())) {
+        throw std::invalid_argument("Invalid arguments. Expected: import(file[,ids_file]) or migrate(address[,ids_file])");
+    }
+
+    return {args[0], args.size() == 2 ? args[1] : std::string_view()};
+}
@@ -2,25 +2,56 @@
 #define PARSING_H
 
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 #include <stdexcept>
 
+// Commands are parsed in place: names and arguments are views into the input line,
+// so the line must outlive them.
 class CommandParser {
 public:
-    // Parses a command like "command(arg1,arg2,...)" and returns the command name and arguments
-    static std::pair<std::string, std::vector<std::string>> parseCommand(const std::string& input);
+    // Parses a command like "command(arg1,arg2,...)" and returns the command name and arguments.
+    // Spaces around the name and each argument are dropped.
+    static std::pair<std::string_view, std::vector<std::string_view>> parseCommand(std::string_view input);
+
+    // Same, filling args so a caller parsing many lines can reuse its capacity
+    static std::string_view parseCommand(std::string_view input, std::vector<std::string_view>& args);
+
+    // Parses a whole argument, with an optional sign, as an int; throws std::invalid_argument or
+    // std::out_of_range like std::stoi
+    static int parseInt(std::string_view text);
 
     // Validates and parses the "create" command
-    static std::pair<int, std::string> parseCreate(const std::vector<std::string>& args);
+    static std::pair<int, std::string_view> parseCreate(const std::vector<std::string_view>& args);
 
     // Validates and parses the "set" command
-    static std::pair<int, std::string> parseSet(const std::vector<std::string>& args);
+    static std::pair<int, std::string_view> parseSet(const std::vector<std::string_view>& args);
 
     // Validates and parses the "get" command
-    static int parseGet(const std::vector<std::string>& args);
+    static int parseGet(const std::vector<std::string_view>& args);
 
     // Validates and parses the "increaseRefCount" and "decreaseRefCount" commands
-    static int parseRefCount(const std::vector<std::string>& args);
+    static int parseRefCount(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "setReference" command
+    static std::tuple<int, int, int> parseSetReference(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "traverse" command, the limit is optional
+    static std::pair<int, int> parseTraverse(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "benchmark" command
+    static int parseBenchmark(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "refbench" command: the most threads and the iterations of each
+    static std::pair<int, int> parseRefBenchmark(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "export" command: a file
+    static std::string_view parseTarget(const std::vector<std::string_view>& args);
+
+    // Validates and parses the "import" and "migrate" commands: a file or a server address,
+    // then optionally a file for the id mapping (empty when not given)
+    static std::pair<std::string_view, std::string_view> parseImport(const std::vector<std::string_view>& args);
 };
 
-#endif // PARSING_H
\ No newline at end of file
+#endif // PARSING_H
@@ -0,0 +1,103 @@
+#include "ref_count_table.h"
+#include <algorithm>
+#include <thread>
+
+int RefCount::load() const {
+    return value.load(std::memory_order_acquire);
+}
+
+void RefCount::reset(int count) {
+    value.store(count, std::memory_order_release);
+}
+
+int RefCount::add(int delta, int& previous) {
+    int current = value.load(std::memory_order_relaxed);
+    while (true) {
+        if (current == FROZEN) {
+            // Only held for the few checks a collector makes under the lock
+            std::this_thread::yield();
+            current = value.load(std::memory_order_relaxed);
+            continue;
+        }
+        previous = current;
+        if (current < 0) {
+            return FREED;
+        }
+        int next = std::max(0, current + delta);
+        if (next == current) {
+            return current;
+        }
+        if (value.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return next;
+        }
+    }
+}
+
+int RefCount::add(int delta) {
+    int previous;
+    return add(delta, previous);
+}
+
+int RefCount::try_increment() {
+    int current = value.load(std::memory_order_relaxed);
+    while (true) {
+        if (current == FROZEN) {
+            std::this_thread::yield();
+            current = value.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (current <= 0) {
+            return FREED;
+        }
+        if (value.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return current + 1;
+        }
+    }
+}
+
+bool RefCount::freeze(int expected) {
+    return value.compare_exchange_strong(expected, FROZEN, std::memory_order_acq_rel);
+}
+
+void RefCount::thaw(int count) {
+    value.store(count, std::memory_order_release);
+}
+
+bool RefCount::release(int expected) {
+    return value.compare_exchange_strong(expected, FREED, std::memory_order_acq_rel);
+}
+
+void RefCount::mark_freed() {
+    value.store(FREED, std::memory_order_release);
+}
+
+RefCountTable::RefCountTable() : directory(new std::atomic<RefCount*>[DIRECTORY_SIZE]) {
+    for (size_t i = 0; i < DIRECTORY_SIZE; ++i) {
+        directory[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+RefCountTable::~RefCountTable() {
+    for (size_t i = 0; i < DIRECTORY_SIZE; ++i) {
+        delete[] directory[i].load(std::memory_order_relaxed);
+    }
+}
+
+RefCount* RefCountTable::at(int id) {
+    std::atomic<RefCount*>& slot = directory[static_cast<size_t>(id) >> CHUNK_BITS];
+    RefCount* chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        // Entries start out FREED, so lookups racing with the publish see no block
+        chunk = new RefCount[CHUNK_SIZE];
+        slot.store(chunk, std::memory_order_release);
+    }
+    return &chunk[static_cast<size_t>(id) & (CHUNK_SIZE - 1)];
+}
+
+RefCount* RefCountTable::find(int id) const {
+    if (id <= 0) {
+        return nullptr;
+    }
+    RefCount* chunk = directory[static_cast<size_t>(id) >> CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk != nullptr ? &chunk[static_cast<size_t>(id) & (CHUNK_SIZE - 1)] : nullptr;
+}
@@ -0,0 +1,68 @@
+#ifndef REF_COUNT_TABLE_H
+#define REF_COUNT_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Reference count of one block. It only changes through atomic read-modify-writes,
+// so the ref count RPCs can run without the manager's lock. Negative values are
+// states, not counts.
+class RefCount {
+public:
+    static constexpr int FREED = -1;  // Never created, or already freed
+    static constexpr int FROZEN = -2; // A collector is deciding whether to free the block
+
+    int load() const;
+
+    // Sets the count of a block being created or replicated
+    void reset(int count);
+
+    // Adds delta and returns the new count; a decrement stops at 0. Returns FREED when the
+    // block is gone. previous is set to the count before.
+    int add(int delta, int& previous);
+    int add(int delta);
+
+    // Adds one unless the count already reached zero. Returns FREED when it had.
+    int try_increment();
+
+    // For the collectors, under the manager's lock. freeze holds the count at expected
+    // (changes wait) and fails if it moved; thaw lets it go again, release frees it.
+    bool freeze(int expected);
+    void thaw(int count);
+    bool release(int expected);
+    void mark_freed();
+
+    // Set once the block has a pointer slot, so a drop in its count may leave a cycle behind
+    std::atomic<bool> has_references{false};
+
+private:
+    std::atomic<int> value{FREED};
+};
+
+// The counts of every block, indexed by id. Ids are never reused, so an entry stays
+// valid for the life of the table and can be found without any lock; the chunks
+// holding them are allocated as ids reach them and never freed.
+class RefCountTable {
+public:
+    RefCountTable();
+    ~RefCountTable();
+
+    RefCountTable(const RefCountTable&) = delete;
+    RefCountTable& operator=(const RefCountTable&) = delete;
+
+    // Entry of a block being created. Called with the manager's lock held.
+    RefCount* at(int id);
+
+    // Entry of id, or nullptr when no block got near it yet. Lock-free.
+    RefCount* find(int id) const;
+
+private:
+    static constexpr int CHUNK_BITS = 16;
+    static constexpr size_t CHUNK_SIZE = size_t{1} << CHUNK_BITS;
+    static constexpr size_t DIRECTORY_SIZE = (size_t{1} << 31) >> CHUNK_BITS;
+
+    std::unique_ptr<std::atomic<RefCount*>[]> directory;
+};
+
+#endif // REF_COUNT_TABLE_H
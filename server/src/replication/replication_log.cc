@@ -0,0 +1,255 @@
+#include "replication_log.h"
+#include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "proto/hello.grpc.pb.h"
+#include "../mem_mgr.h"
+
+// Entries per ReplicationBatch message
+static constexpr size_t MAX_BATCH_ENTRIES = 1024;
+
+// Block bytes copied under the manager's lock per piece of a snapshot
+static constexpr size_t SNAPSHOT_PIECE_BYTES = 1024 * 1024;
+
+// Pause after a failed stream, doubled on every failure in a row
+static constexpr std::chrono::milliseconds MIN_RETRY_DELAY{1000};
+static constexpr std::chrono::milliseconds MAX_RETRY_DELAY{60000};
+
+class ReplicationLog::StandbySender {
+public:
+    StandbySender(MemoryManager* memory_manager, const std::string& address)
+        : memory_manager(memory_manager), address(address),
+          channel(grpc::CreateChannel(address, grpc::InsecureChannelCredentials())),
+          stub(memory_manager::MemoryManager::NewStub(channel)) {
+    }
+
+    ~StandbySender() {
+        stop();
+    }
+
+    void start() {
+        should_stop = false;
+        sender_thread = std::thread(&StandbySender::send_loop, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            should_stop = true;
+            if (stream_context != nullptr) {
+                stream_context->TryCancel();
+            }
+        }
+        cv.notify_one();
+        if (sender_thread.joinable()) {
+            sender_thread.join();
+        }
+    }
+
+    void enqueue(const memory_manager::ReplicationEntry& entry) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!connected) {
+                return; // The snapshot sent on reconnect covers it
+            }
+            queue.push_back(entry);
+        }
+        cv.notify_one();
+    }
+
+private:
+    // Waits for the channel to the standby to come up, so nothing is copied for one that
+    // is down. Returns false when stopped first.
+    bool wait_for_standby() {
+        while (!should_stop) {
+            if (channel->WaitForConnected(std::chrono::system_clock::now() + std::chrono::seconds(1))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void send_loop() {
+        auto install = [this](std::vector<memory_manager::ReplicationEntry>& entries) {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& entry : entries) {
+                queue.push_back(std::move(entry));
+            }
+        };
+
+        std::chrono::milliseconds retry_delay = MIN_RETRY_DELAY;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!should_stop) {
+            lock.unlock();
+            if (!wait_for_standby()) {
+                lock.lock();
+                break;
+            }
+
+            grpc::ClientContext context;
+            memory_manager::ReplicationAck ack;
+            lock.lock();
+            stream_context = &context;
+            lock.unlock();
+
+            std::unique_ptr<grpc::ClientWriter<memory_manager::ReplicationBatch>> writer(
+                stub->Replicate(&context, &ack));
+
+            // Replace whatever was queued with the start of a snapshot taken under the
+            // manager's lock, so the entries logged afterwards continue exactly from it.
+            // The blocks follow a piece at a time, queued behind what was logged meanwhile.
+            std::vector<int> snapshot_ids =
+                memory_manager->replication_snapshot_begin([this](std::vector<memory_manager::ReplicationEntry>& entries) {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    queue.swap(entries);
+                    connected = true;
+                });
+            size_t snapshot_next = 0;
+            std::cout << "Replicating to standby " << address << std::endl;
+
+            bool stream_ok = true;
+            lock.lock();
+            while (stream_ok && !should_stop) {
+                if (snapshot_next < snapshot_ids.size()) {
+                    lock.unlock();
+                    snapshot_next = memory_manager->replication_snapshot_next(snapshot_ids, snapshot_next,
+                                                                              SNAPSHOT_PIECE_BYTES, install);
+                    lock.lock();
+                }
+                cv.wait(lock, [this] { return !queue.empty() || should_stop; });
+                std::vector<memory_manager::ReplicationEntry> pending;
+                pending.swap(queue);
+                lock.unlock();
+
+                memory_manager::ReplicationBatch batch;
+                for (size_t i = 0; i < pending.size() && stream_ok; ++i) {
+                    *batch.add_entries() = std::move(pending[i]);
+                    if (static_cast<size_t>(batch.entries_size()) == MAX_BATCH_ENTRIES || i + 1 == pending.size()) {
+                        stream_ok = writer->Write(batch);
+                        batch.clear_entries();
+                    }
+                }
+                if (stream_ok && snapshot_next == snapshot_ids.size()) {
+                    retry_delay = MIN_RETRY_DELAY; // The standby took the whole snapshot
+                }
+                lock.lock();
+            }
+            connected = false;
+            queue.clear();
+            stream_context = nullptr;
+            lock.unlock();
+
+            writer->WritesDone();
+            grpc::Status status = writer->Finish();
+            if (!status.ok() && !should_stop) {
+                std::cerr << "Replication to " << address << " interrupted: " << status.error_message()
+                          << ", retrying in " << retry_delay.count() << " ms" << std::endl;
+            }
+
+            lock.lock();
+            cv.wait_for(lock, retry_delay, [this] { return should_stop.load(); });
+            retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+        }
+    }
+
+    MemoryManager* memory_manager;
+    std::string address;
+    std::shared_ptr<grpc::Channel> channel;
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub;
+
+    std::thread sender_thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<memory_manager::ReplicationEntry> queue;
+    grpc::ClientContext* stream_context = nullptr;
+    bool connected = false;
+    std::atomic<bool> should_stop{false};
+};
+
+ReplicationLog::ReplicationLog(MemoryManager* memory_manager) : memory_manager(memory_manager) {
+}
+
+ReplicationLog::~ReplicationLog() {
+    stop();
+}
+
+void ReplicationLog::add_standby(const std::string& address) {
+    senders.push_back(std::make_unique<StandbySender>(memory_manager, address));
+}
+
+bool ReplicationLog::has_standbys() const {
+    return !senders.empty();
+}
+
+void ReplicationLog::start() {
+    for (auto& sender : senders) {
+        sender->start();
+    }
+}
+
+void ReplicationLog::stop() {
+    for (auto& sender : senders) {
+        sender->stop();
+    }
+}
+
+void ReplicationLog::append(memory_manager::ReplicationEntry&& entry) {
+    entry.set_sequence(next_sequence++);
+    for (auto& sender : senders) {
+        sender->enqueue(entry);
+    }
+}
+
+void ReplicationLog::log_create(int id, size_t size, const std::string& type, size_t count, size_t alignment) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::CREATE);
+    entry.set_id(id);
+    entry.set_size(static_cast<int>(size));
+    entry.set_type(type);
+    entry.set_count(static_cast<int>(count));
+    entry.set_alignment(static_cast<int>(alignment));
+    append(std::move(entry));
+}
+
+void ReplicationLog::log_set(int id, const void* data, size_t size, size_t offset) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::SET);
+    entry.set_id(id);
+    entry.set_offset(offset);
+    entry.set_value(static_cast<const char*>(data), size);
+    append(std::move(entry));
+}
+
+void ReplicationLog::log_ref_count(int id, int ref_count) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::REF_COUNT);
+    entry.set_id(id);
+    entry.set_ref_count(ref_count);
+    append(std::move(entry));
+}
+
+void ReplicationLog::log_reference(int id, int slot, int target_id) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::REFERENCE);
+    entry.set_id(id);
+    entry.set_slot(slot);
+    entry.set_target_id(target_id);
+    append(std::move(entry));
+}
+
+void ReplicationLog::log_free(int id) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::FREE);
+    entry.set_id(id);
+    append(std::move(entry));
+}
+
+void ReplicationLog::log_register_type(const std::string& name, size_t size, size_t alignment) {
+    memory_manager::ReplicationEntry entry;
+    entry.set_kind(memory_manager::ReplicationEntry::REGISTER_TYPE);
+    entry.set_type(name);
+    entry.set_size(static_cast<int>(size));
+    entry.set_alignment(static_cast<int>(alignment));
+    append(std::move(entry));
+}
@@ -0,0 +1,52 @@
+#ifndef REPLICATION_LOG_H
+#define REPLICATION_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "proto/hello.pb.h"
+
+class MemoryManager;
+
+// Primary side of replication. The memory manager records every mutation here
+// while holding its lock; recording only queues the entry, and one sender thread
+// per standby streams the queue in batches without waiting for acknowledgements.
+// A sender waits for its standby's channel to come up, then ships a snapshot of the
+// heap a piece at a time before the entries logged meanwhile, so entries are only
+// queued for standbys that are currently connected. Failed streams are retried with
+// exponential backoff.
+class ReplicationLog {
+public:
+    explicit ReplicationLog(MemoryManager* memory_manager);
+    ~ReplicationLog();
+
+    void add_standby(const std::string& address);
+    bool has_standbys() const;
+
+    void start();
+    void stop();
+
+    // Mutations, called with the memory manager's lock held
+    void log_create(int id, size_t size, const std::string& type, size_t count, size_t alignment);
+    void log_set(int id, const void* data, size_t size, size_t offset = 0);
+    void log_ref_count(int id, int ref_count);
+    void log_reference(int id, int slot, int target_id);
+    void log_free(int id);
+    void log_register_type(const std::string& name, size_t size, size_t alignment);
+
+private:
+    class StandbySender;
+
+    void append(memory_manager::ReplicationEntry&& entry);
+
+    MemoryManager* memory_manager;
+    std::vector<std::unique_ptr<StandbySender>> senders;
+    uint64_t next_sequence = 1; // Guarded by the memory manager's lock
+};
+
+#endif // REPLICATION_LOG_H
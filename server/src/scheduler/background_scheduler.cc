@@ -0,0 +1,193 @@
+#include "background_scheduler.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "../heap/memory_policy.h"
+
+static size_t index_of(TaskClass task_class) {
+    return static_cast<size_t>(task_class);
+}
+
+const char* task_class_name(TaskClass task_class) {
+    switch (task_class) {
+        case TaskClass::Gc:
+            return "gc";
+        case TaskClass::Defrag:
+            return "defrag";
+        case TaskClass::Dump:
+            return "dump";
+    }
+    return "unknown";
+}
+
+// Requests in flight beyond which maintenance backs off; 0 means one per hardware thread
+BackgroundScheduler::BackgroundScheduler(size_t busy_requests)
+    : busy_requests(busy_requests > 0 ? busy_requests : std::max(1u, std::thread::hardware_concurrency())) {
+    // Collection is cheap and frees memory, compaction holds the lock the longest,
+    // dumps are mostly file I/O outside the lock
+    pools[index_of(TaskClass::Gc)].options = {1, {}, 5, 0.5};
+    pools[index_of(TaskClass::Defrag)].options = {1, {}, 10, 0.25};
+    pools[index_of(TaskClass::Dump)].options = {1, {}, 15, 1.0};
+}
+
+BackgroundScheduler::~BackgroundScheduler() {
+    stop();
+}
+
+void BackgroundScheduler::configure(TaskClass task_class, const PoolOptions& options) {
+    if (running) {
+        throw std::logic_error("Pools can't be reconfigured once started");
+    }
+    pools[index_of(task_class)].options = options;
+}
+
+const PoolOptions& BackgroundScheduler::options(TaskClass task_class) const {
+    return pools[index_of(task_class)].options;
+}
+
+void BackgroundScheduler::start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    for (size_t i = 0; i < TASK_CLASS_COUNT; ++i) {
+        Pool& pool = pools[i];
+        pool.should_stop = false;
+        for (size_t t = 0; t < std::max<size_t>(pool.options.threads, 1); ++t) {
+            pool.threads.emplace_back(&BackgroundScheduler::run, this, static_cast<TaskClass>(i));
+        }
+        std::cout << "Started " << pool.threads.size() << " " << task_class_name(static_cast<TaskClass>(i))
+                  << " worker(s), nice " << pool.options.nice << ", duty cycle " << pool.options.duty_cycle
+                  << std::endl;
+    }
+}
+
+void BackgroundScheduler::stop() {
+    for (Pool& pool : pools) {
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.should_stop = true;
+        }
+        pool.cv.notify_all();
+    }
+    for (Pool& pool : pools) {
+        for (std::thread& thread : pool.threads) {
+            thread.join();
+        }
+        pool.threads.clear();
+    }
+    running = false;
+}
+
+bool BackgroundScheduler::submit(TaskClass task_class, std::function<void()> task) {
+    Pool& pool = pools[index_of(task_class)];
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.should_stop || !running) {
+            return false;
+        }
+        pool.tasks.push_back(std::move(task));
+    }
+    pool.cv.notify_one();
+    return true;
+}
+
+bool BackgroundScheduler::under_pressure() const {
+    return in_flight.load() > static_cast<int>(busy_requests);
+}
+
+void BackgroundScheduler::run(TaskClass task_class) {
+    Pool& pool = pools[index_of(task_class)];
+
+    // Both apply to the calling thread only
+    if (!pool.options.cpus.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : pool.options.cpus) {
+            CPU_SET(cpu, &cpus);
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            std::cerr << "Failed to pin " << task_class_name(task_class) << " worker" << std::endl;
+        }
+    }
+    if (pool.options.nice != 0 &&
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), getpriority(PRIO_PROCESS, 0) + pool.options.nice) == -1) {
+        std::cerr << "Failed to renice " << task_class_name(task_class) << " worker: " << std::strerror(errno) << std::endl;
+    }
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while (true) {
+        pool.cv.wait(lock, [&pool] { return pool.should_stop || !pool.tasks.empty(); });
+        if (pool.tasks.empty()) {
+            break; // Stopping, and everything queued has run
+        }
+        std::function<void()> task = std::move(pool.tasks.front());
+        pool.tasks.pop_front();
+        lock.unlock();
+
+        auto started = std::chrono::steady_clock::now();
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << task_class_name(task_class) << " task failed: " << e.what() << std::endl;
+        }
+
+        // Pause long enough that busy time stays within the duty cycle
+        double duty_cycle = pool.options.duty_cycle;
+        if (duty_cycle > 0 && duty_cycle < 1 && under_pressure()) {
+            auto busy = std::chrono::steady_clock::now() - started;
+            auto pause = std::chrono::duration_cast<std::chrono::microseconds>(busy * ((1 - duty_cycle) / duty_cycle));
+            lock.lock();
+            pool.cv.wait_for(lock, pause, [&pool] { return pool.should_stop; });
+        } else {
+            lock.lock();
+        }
+    }
+}
+
+void parse_pool_option(const std::string& value, BackgroundScheduler& scheduler) {
+    size_t colon = value.find(':');
+    std::string name = value.substr(0, colon);
+    TaskClass task_class;
+    if (name == "gc") {
+        task_class = TaskClass::Gc;
+    } else if (name == "defrag") {
+        task_class = TaskClass::Defrag;
+    } else if (name == "dump") {
+        task_class = TaskClass::Dump;
+    } else {
+        throw std::invalid_argument("--pool must name gc, defrag or dump, not " + name);
+    }
+
+    PoolOptions options = scheduler.options(task_class);
+    std::stringstream settings(colon == std::string::npos ? "" : value.substr(colon + 1));
+    std::string setting;
+    while (std::getline(settings, setting, ',')) {
+        size_t equals = setting.find('=');
+        std::string key = setting.substr(0, equals);
+        std::string argument = equals == std::string::npos ? "" : setting.substr(equals + 1);
+        try {
+            if (key == "threads") {
+                options.threads = std::stoul(argument);
+            } else if (key == "nice") {
+                options.nice = std::stoi(argument);
+            } else if (key == "duty") {
+                options.duty_cycle = std::stod(argument);
+            } else if (key == "cpus") {
+                options.cpus = parse_id_list(argument);
+            } else {
+                throw std::invalid_argument(key);
+            }
+        } catch (const std::exception&) {
+            throw std::invalid_argument("Bad --pool setting " + setting + " for " + name);
+        }
+    }
+    scheduler.configure(task_class, options);
+}
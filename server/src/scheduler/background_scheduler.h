@@ -0,0 +1,98 @@
+#ifndef BACKGROUND_SCHEDULER_H
+#define BACKGROUND_SCHEDULER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Kinds of maintenance work, each with its own pool of threads
+enum class TaskClass { Gc, Defrag, Dump };
+
+constexpr size_t TASK_CLASS_COUNT = 3;
+
+// How one pool's threads run
+struct PoolOptions {
+    size_t threads = 1;
+    std::vector<int> cpus; // Pinned to these CPUs, empty for anywhere
+    int nice = 0;          // Added to the process's nice level for these threads
+    double duty_cycle = 1.0; // Share of time the pool may be busy while requests are queueing
+};
+
+// Runs GC, compaction and dump writing off the request threads. Every class of
+// task has its own pool, so a long compaction never holds up a dump and none of
+// them takes a request thread. While more requests are in flight than
+// busy_requests, a pool with a duty cycle below 1 pauses after each task in
+// proportion to how long it ran, leaving the CPUs and the manager's lock to the
+// requests.
+class BackgroundScheduler {
+public:
+    explicit BackgroundScheduler(size_t busy_requests = 0);
+    ~BackgroundScheduler();
+
+    BackgroundScheduler(const BackgroundScheduler&) = delete;
+    BackgroundScheduler& operator=(const BackgroundScheduler&) = delete;
+
+    // Only before start()
+    void configure(TaskClass task_class, const PoolOptions& options);
+    const PoolOptions& options(TaskClass task_class) const;
+
+    void start();
+
+    // Runs what is still queued, then stops the threads
+    void stop();
+
+    // Queues a task; false once stopped
+    bool submit(TaskClass task_class, std::function<void()> task);
+
+    // Counts requests in flight for the duty cycles. Streams that stay open for the
+    // life of a client don't count.
+    class RequestScope {
+    public:
+        explicit RequestScope(BackgroundScheduler* scheduler) : scheduler(scheduler) {
+            if (scheduler != nullptr) {
+                scheduler->in_flight++;
+            }
+        }
+        ~RequestScope() {
+            if (scheduler != nullptr) {
+                scheduler->in_flight--;
+            }
+        }
+
+    private:
+        BackgroundScheduler* scheduler;
+    };
+
+private:
+    struct Pool {
+        PoolOptions options;
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool should_stop = false;
+    };
+
+    void run(TaskClass task_class);
+    bool under_pressure() const;
+
+    std::array<Pool, TASK_CLASS_COUNT> pools;
+    size_t busy_requests;
+    std::atomic<int> in_flight{0};
+    bool running = false;
+};
+
+const char* task_class_name(TaskClass task_class);
+
+// Parses a --pool value such as "defrag:threads=1,nice=10,duty=0.25,cpus=2-3";
+// throws std::invalid_argument
+void parse_pool_option(const std::string& value, BackgroundScheduler& scheduler);
+
+#endif // BACKGROUND_SCHEDULER_H
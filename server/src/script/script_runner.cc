@@ -0,0 +1,402 @@
+#include "script_runner.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "parsing/parsing.h"
+
+ScriptRunner::ScriptRunner(const std::shared_ptr<grpc::Channel>& channel, size_t window)
+    : stub(memory_manager::MemoryManager::NewStub(channel)), window(std::max<size_t>(window, 1)) {
+    async.start(memory_manager::MemoryManager::NewStub(channel));
+}
+
+size_t ScriptRunner::run(const std::string& path) {
+    // Read the whole script up front; the parsed commands are views into it
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Could not open script " + path);
+    }
+    std::string script(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(script.data(), static_cast<std::streamsize>(script.size()));
+
+    std::string_view rest(script);
+    size_t line_number = 0;
+    while (!rest.empty()) {
+        size_t end = rest.find('\n');
+        std::string_view line = rest.substr(0, end);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        ++line_number;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line == "exit") {
+            break;
+        }
+        run_line(line, line_number);
+        print_ready(false);
+    }
+
+    flush_creates();
+    flush_ref_counts();
+    print_ready(true);
+    std::cout.flush();
+    return failures;
+}
+
+void ScriptRunner::run_line(std::string_view line, size_t line_number) {
+    size_t first = line.find_first_not_of(" \t");
+    if (first == std::string_view::npos || line[first] == '#') {
+        return; // Blank lines and comments
+    }
+
+    Result* result = add_result(line_number);
+    try {
+        std::string_view command = CommandParser::parseCommand(line, args);
+
+        // Creates and reference count changes wait for the next different command, to go out together
+        if (command == "create") {
+            auto [size, type] = CommandParser::parseCreate(args);
+            flush_ref_counts();
+            if (!creates.results.empty() && (creates.size != size || creates.type != type)) {
+                flush_creates();
+            }
+            creates.size = size;
+            creates.type = type;
+            creates.results.push_back(result);
+            if (creates.results.size() >= window) {
+                flush_creates();
+            }
+            return;
+        }
+        if (command == "increaseRefCount" || command == "decreaseRefCount") {
+            int id = CommandParser::parseRefCount(args);
+            flush_creates();
+            ref_counts.push_back({result, id, command == "increaseRefCount" ? 1 : -1});
+            if (ref_counts.size() >= window) {
+                flush_ref_counts();
+            }
+            return;
+        }
+
+        flush_creates();
+        flush_ref_counts();
+        if (command == "get") {
+            send_get(result, CommandParser::parseGet(args));
+        } else if (command == "set") {
+            auto [id, value] = CommandParser::parseSet(args);
+            send_set(result, id, value);
+        } else if (command == "setReference") {
+            auto [id, slot, target_id] = CommandParser::parseSetReference(args);
+            send_set_reference(result, id, slot, target_id);
+        } else if (command == "traverse") {
+            auto [head_id, limit] = CommandParser::parseTraverse(args);
+            run_traverse(result, head_id, limit);
+        } else if (command == "linked_list" || command == "benchmark" || command == "refbench" ||
+                   command == "export" || command == "import" || command == "migrate") {
+            finish(result, true, std::string(command) + " is only available interactively");
+        } else {
+            finish(result, true, "Unknown command: " + std::string(command));
+        }
+    } catch (const std::exception& e) {
+        finish(result, true, std::string("Error: ") + e.what());
+    }
+}
+
+ScriptRunner::Result* ScriptRunner::add_result(size_t line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.push_back(Result{line, false, false, {}});
+    return &results.back(); // Stays put: the deque only grows at the back and shrinks at the front
+}
+
+void ScriptRunner::finish(Result* result, bool failed, std::string text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    finish_locked(result, failed, std::move(text));
+}
+
+void ScriptRunner::finish_locked(Result* result, bool failed, std::string text) {
+    result->done = true;
+    result->failed = failed;
+    result->text = std::move(text);
+    if (failed) {
+        ++failures;
+    }
+}
+
+// Prints the finished results at the front. Failures go to stderr, after flushing
+// stdout so the two streams stay in script order on a terminal.
+void ScriptRunner::print_ready(bool wait_all) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait_all) {
+            cv.wait(lock, [this] { return in_flight == 0; });
+        }
+        while (!results.empty() && results.front().done) {
+            printing.push_back(std::move(results.front()));
+            results.pop_front();
+        }
+    }
+
+    for (const Result& result : printing) {
+        if (result.failed) {
+            std::cout.flush();
+            std::cerr << "Line " << result.line << ": " << result.text << '\n';
+        } else {
+            std::cout << result.text << '\n';
+        }
+    }
+    printing.clear();
+}
+
+void ScriptRunner::wait_for_slot(std::unique_lock<std::mutex>& lock, const std::vector<int>& reads,
+                                 const std::vector<int>& writes) {
+    auto busy = [](const std::unordered_map<int, int>& in_use, int id) {
+        return in_use.find(id) != in_use.end();
+    };
+    cv.wait(lock, [&] {
+        if (in_flight >= window) {
+            return false;
+        }
+        for (int id : reads) {
+            if (busy(writing, id)) {
+                return false;
+            }
+        }
+        for (int id : writes) {
+            if (busy(reading, id) || busy(writing, id)) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    track(reads, reading, 1);
+    track(writes, writing, 1);
+    ++in_flight;
+}
+
+// Called from the completion thread with the mutex held, once a call's results are in
+void ScriptRunner::release_locked(const std::vector<int>& reads, const std::vector<int>& writes) {
+    track(reads, reading, -1);
+    track(writes, writing, -1);
+    --in_flight;
+    cv.notify_all();
+}
+
+void ScriptRunner::track(const std::vector<int>& ids, std::unordered_map<int, int>& in_use, int delta) {
+    for (int id : ids) {
+        int& calls = in_use[id];
+        calls += delta;
+        if (calls == 0) {
+            in_use.erase(id);
+        }
+    }
+}
+
+void ScriptRunner::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return in_flight == 0; });
+}
+
+void ScriptRunner::send_get(Result* result, int id) {
+    memory_manager::GetRequest request;
+    request.set_id(id);
+
+    std::vector<int> reads{id};
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait_for_slot(lock, reads, {});
+    }
+    async.call<memory_manager::GetResponse>(
+        [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+            return stub->PrepareAsyncGet(context, request, cq);
+        },
+        [this, result, reads](const grpc::Status& status, const memory_manager::GetResponse& response) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!status.ok() || !response.success()) {
+                finish_locked(result, true, "Get failed: " + (status.ok() ? response.message() : status.error_message()));
+            } else {
+                finish_locked(result, false, "Value = " + response.value());
+            }
+            release_locked(reads, {});
+        });
+}
+
+void ScriptRunner::send_set(Result* result, int id, std::string_view value) {
+    memory_manager::SetRequest request;
+    request.set_id(id);
+    request.set_value(std::string(value));
+
+    std::vector<int> writes{id};
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait_for_slot(lock, {}, writes);
+    }
+    async.call<memory_manager::SetResponse>(
+        [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+            return stub->PrepareAsyncSet(context, request, cq);
+        },
+        [this, result, writes](const grpc::Status& status, const memory_manager::SetResponse& response) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!status.ok() || !response.success()) {
+                finish_locked(result, true, "Set failed: " + (status.ok() ? response.message() : status.error_message()));
+            } else {
+                finish_locked(result, false, response.message());
+            }
+            release_locked({}, writes);
+        });
+}
+
+void ScriptRunner::send_set_reference(Result* result, int id, int slot, int target_id) {
+    memory_manager::ReferenceRequest request;
+    request.set_id(id);
+    request.set_slot(slot);
+    request.set_target_id(target_id);
+
+    // The target's count changes too
+    std::vector<int> writes{id};
+    if (target_id != -1 && target_id != id) {
+        writes.push_back(target_id);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait_for_slot(lock, {}, writes);
+    }
+    async.call<memory_manager::ReferenceResponse>(
+        [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+            return stub->PrepareAsyncSetReference(context, request, cq);
+        },
+        [this, result, writes](const grpc::Status& status, const memory_manager::ReferenceResponse& response) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!status.ok() || !response.success()) {
+                finish_locked(result, true,
+                              "SetReference failed: " + (status.ok() ? response.message() : status.error_message()));
+            } else {
+                finish_locked(result, false, response.message());
+            }
+            release_locked({}, writes);
+        });
+}
+
+// Sends the queued reference count changes as one UpdateRefCounts call, applied in script order
+void ScriptRunner::flush_ref_counts() {
+    if (ref_counts.empty()) {
+        return;
+    }
+
+    memory_manager::RefCountBatchRequest request;
+    std::vector<int> writes;
+    writes.reserve(ref_counts.size());
+    for (const RefCountChange& change : ref_counts) {
+        memory_manager::RefCountDelta* delta = request.add_deltas();
+        delta->set_id(change.id);
+        delta->set_delta(change.delta);
+        writes.push_back(change.id);
+    }
+    std::vector<Result*> batch;
+    batch.reserve(ref_counts.size());
+    for (const RefCountChange& change : ref_counts) {
+        batch.push_back(change.result);
+    }
+    ref_counts.clear();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait_for_slot(lock, {}, writes);
+    }
+    async.call<memory_manager::RefCountBatchResponse>(
+        [request](memory_manager::MemoryManager::Stub* stub, grpc::ClientContext* context, grpc::CompletionQueue* cq) {
+            return stub->PrepareAsyncUpdateRefCounts(context, request, cq);
+        },
+        [this, batch, writes](const grpc::Status& status, const memory_manager::RefCountBatchResponse& response) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!status.ok() || static_cast<int>(i) >= response.new_ref_counts_size()) {
+                    finish_locked(batch[i], true, "RefCount failed: " + (status.ok() ? response.message()
+                                                                                     : status.error_message()));
+                } else if (response.new_ref_counts(static_cast<int>(i)) == -1) {
+                    finish_locked(batch[i], true, "RefCount failed: ID " + std::to_string(writes[i]) + " not found");
+                } else {
+                    finish_locked(batch[i], false, "New RefCount = " + std::to_string(response.new_ref_counts(static_cast<int>(i))));
+                }
+            }
+            release_locked({}, writes);
+        });
+}
+
+// Creates the queued blocks once everything before them is done. A run of several
+// becomes one Reserve, whose ids come out in the order separate creates would give.
+void ScriptRunner::flush_creates() {
+    if (creates.results.empty()) {
+        return;
+    }
+    wait_idle();
+
+    std::vector<Result*> pending;
+    pending.swap(creates.results);
+
+    if (pending.size() > 1) {
+        memory_manager::ReserveRequest request;
+        request.set_size(creates.size);
+        request.set_type(std::string(creates.type));
+        request.set_blocks(static_cast<int>(pending.size()));
+
+        memory_manager::ReserveResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub->Reserve(&context, request, &response);
+        if (status.ok() && response.success() && static_cast<size_t>(response.ids_size()) == pending.size()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < pending.size(); ++i) {
+                finish_locked(pending[i], false, "ID = " + std::to_string(response.ids(static_cast<int>(i))));
+            }
+            return;
+        }
+        // Not all of them fit: create them one by one, so the ones that do still succeed
+    }
+
+    for (Result* result : pending) {
+        memory_manager::CreateRequest request;
+        request.set_size(creates.size);
+        request.set_type(std::string(creates.type));
+
+        memory_manager::CreateResponse response;
+        grpc::ClientContext context;
+        grpc::Status status = stub->Create(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            finish(result, true, "Create failed: " + (status.ok() ? response.message() : status.error_message()));
+        } else {
+            finish(result, false, "ID = " + std::to_string(response.id()));
+        }
+    }
+}
+
+// Traversals read a whole chain, so they run alone
+void ScriptRunner::run_traverse(Result* result, int head_id, int limit) {
+    wait_idle();
+
+    memory_manager::TraverseRequest request;
+    request.set_head_id(head_id);
+    request.set_slot(0);
+    request.set_limit(limit);
+
+    grpc::ClientContext context;
+    auto reader = stub->Traverse(&context, request);
+
+    std::string text;
+    memory_manager::TraverseResponse response;
+    while (reader->Read(&response)) {
+        if (!text.empty()) {
+            text += '\n';
+        }
+        text += "ID = " + std::to_string(response.id()) + ", Value = " + response.value() +
+                ", Next = " + std::to_string(response.next_id());
+    }
+
+    grpc::Status status = reader->Finish();
+    if (!status.ok()) {
+        finish(result, true, "Traverse failed: " + status.error_message());
+    } else {
+        finish(result, false, text);
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef SCRIPT_RUNNER_H
+#define SCRIPT_RUNNER_H
+
+#include <grpcpp/grpcpp.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "proto/hello.grpc.pb.h"
+#include "mpointer/AsyncClient.h"
+
+// In-flight RPCs a script keeps by default
+constexpr size_t DEFAULT_SCRIPT_WINDOW = 256;
+
+// Replays a file of client commands, one per line, without waiting for each reply.
+// Gets, sets and setReference go out as async RPCs, up to window at a time; a
+// command waits only for in-flight ones touching the same block. Consecutive
+// reference count changes become one UpdateRefCounts call and consecutive creates
+// of the same size and type one Reserve. Creates and traversals run alone, since
+// later lines may use the ids they return. Results print in script order.
+class ScriptRunner {
+public:
+    ScriptRunner(const std::shared_ptr<grpc::Channel>& channel, size_t window = DEFAULT_SCRIPT_WINDOW);
+
+    // Runs the script at path and returns the number of commands that failed
+    size_t run(const std::string& path);
+
+private:
+    // Output of one command, printed once it and everything before it are done
+    struct Result {
+        size_t line;
+        bool done = false;
+        bool failed = false;
+        std::string text;
+    };
+
+    struct RefCountChange {
+        Result* result;
+        int id;
+        int delta;
+    };
+
+    struct PendingCreate {
+        int size = 0;
+        std::string_view type; // Views into the script, like every parsed argument
+        std::vector<Result*> results;
+    };
+
+    Result* add_result(size_t line);
+    void finish(Result* result, bool failed, std::string text);
+    void finish_locked(Result* result, bool failed, std::string text);
+    void print_ready(bool wait_all);
+
+    // Blocks until a call may go out: a free window slot and no in-flight call on the
+    // same blocks, then counts it as in flight. Must be called with the mutex held through lock.
+    void wait_for_slot(std::unique_lock<std::mutex>& lock, const std::vector<int>& reads,
+                       const std::vector<int>& writes);
+    void release_locked(const std::vector<int>& reads, const std::vector<int>& writes);
+    void wait_idle();
+    void track(const std::vector<int>& ids, std::unordered_map<int, int>& in_use, int delta);
+
+    void run_line(std::string_view line, size_t line_number);
+    void send_get(Result* result, int id);
+    void send_set(Result* result, int id, std::string_view value);
+    void send_set_reference(Result* result, int id, int slot, int target_id);
+    void flush_ref_counts();
+    void flush_creates();
+    void run_traverse(Result* result, int head_id, int limit);
+
+    std::unique_ptr<memory_manager::MemoryManager::Stub> stub; // Blocking calls: creates and traversals
+    AsyncClient async;
+    size_t window;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Result> results; // Not yet printed, in script order
+    size_t in_flight = 0;
+    std::unordered_map<int, int> reading; // Id -> in-flight calls reading it
+    std::unordered_map<int, int> writing; // Id -> in-flight calls changing it
+    size_t failures = 0;
+
+    // Touched by the script thread only
+    std::vector<std::string_view> args;
+    std::vector<RefCountChange> ref_counts;
+    PendingCreate creates;
+    std::vector<Result> printing;
+};
+
+#endif // SCRIPT_RUNNER_H
@@ -80,6 +80,35 @@ inline bool convert_and_validate(const std::string& type, const std::string& val
     return true;
 }
 
+// Function to add a delta, converted from a string, to a numeric value in place
+inline bool add_value(const std::string& type, const std::string& delta, void* address, size_t block_size) {
+    try {
+        if (type == "int" && block_size >= sizeof(int)) {
+            int value;
+            std::memcpy(&value, address, sizeof(int));
+            value += std::stoi(delta);
+            std::memcpy(address, &value, sizeof(int));
+        } else if (type == "float" && block_size >= sizeof(float)) {
+            float value;
+            std::memcpy(&value, address, sizeof(float));
+            value += std::stof(delta);
+            std::memcpy(address, &value, sizeof(float));
+        } else if (type == "double" && block_size >= sizeof(double)) {
+            double value;
+            std::memcpy(&value, address, sizeof(double));
+            value += std::stod(delta);
+            std::memcpy(address, &value, sizeof(double));
+        } else {
+            throw std::runtime_error("Unsupported type for add: " + type);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Add failed: " << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 // Function to retrieve a value as a string based on its type
 inline std::string retrieve_value_as_string(const std::string& type, const void* address, size_t size) {
     try {
@@ -0,0 +1,51 @@
+#include "session_reaper.h"
+#include <iostream>
+#include "../mem_mgr.h"
+
+SessionReaper::SessionReaper(MemoryManager* memory_manager, std::chrono::milliseconds interval)
+    : memory_manager(memory_manager), interval(interval), should_stop(false), is_running(false) {
+}
+
+SessionReaper::~SessionReaper() {
+    stop();
+}
+
+void SessionReaper::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!is_running) {
+        should_stop = false;
+        reaper_thread = std::thread(&SessionReaper::reap, this);
+        is_running = true;
+        std::cout << "Session reaper started" << std::endl;
+    }
+}
+
+void SessionReaper::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        should_stop = true;
+    }
+    cv.notify_one();
+
+    if (reaper_thread.joinable()) {
+        reaper_thread.join();
+    }
+    is_running = false;
+}
+
+void SessionReaper::reap() {
+    while (!should_stop) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, interval, [this] { return should_stop.load(); });
+            if (should_stop) {
+                break;
+            }
+        }
+
+        size_t expired = memory_manager->expire_sessions();
+        if (expired > 0) {
+            std::cout << "Session reaper closed " << expired << " expired sessions" << std::endl;
+        }
+    }
+}
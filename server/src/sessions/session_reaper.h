@@ -0,0 +1,37 @@
+#ifndef SESSION_REAPER_H
+#define SESSION_REAPER_H
+
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include "../mem_mgr.h"
+#include <atomic>
+#include <mutex>
+
+// Closes sessions whose client stopped renewing them, releasing their blocks.
+// Leases are checked every interval, so one can outlive its deadline by that much.
+class SessionReaper {
+public:
+    SessionReaper(MemoryManager* memory_manager, std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+    ~SessionReaper();
+
+    void start();
+    void stop();
+
+    MemoryManager* memory_manager;
+
+private:
+    void reap();
+
+    std::thread reaper_thread;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::chrono::milliseconds interval;
+
+    std::atomic<bool> should_stop;
+    std::atomic<bool> is_running;
+};
+
+#endif // SESSION_REAPER_H
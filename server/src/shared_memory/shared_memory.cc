@@ -0,0 +1,77 @@
+#include "shared_memory.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+SharedMemoryChunk::SharedMemoryChunk(const std::string& name, size_t data_size)
+    : name(name[0] == '/' ? name : "/" + name), mapped_size(SHM_HEADER_SIZE + data_size) {
+    // Owner only, like the spill file: the chunk holds every block. An object left by an
+    // earlier run keeps its old mode, so it is set again.
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd == -1) {
+        throw std::runtime_error("shm_open failed for " + this->name + ": " + std::strerror(errno));
+    }
+    if (fchmod(fd, 0600) == -1) {
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("fchmod failed for " + this->name + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, static_cast<off_t>(mapped_size)) == -1) {
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("ftruncate failed for " + this->name + ": " + std::strerror(errno));
+    }
+
+    base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("mmap failed for " + this->name + ": " + std::strerror(errno));
+    }
+
+    header = new (base) ShmHeader();
+    header->sequence.store(0);
+    header->active_writers.store(0);
+    header->data_size = data_size;
+
+    std::cout << "Memory chunk shared as " << this->name << std::endl;
+}
+
+SharedMemoryChunk::~SharedMemoryChunk() {
+    if (base != nullptr) {
+        munmap(base, mapped_size);
+        shm_unlink(name.c_str());
+    }
+}
+
+void* SharedMemoryChunk::data() const {
+    return static_cast<char*>(base) + SHM_HEADER_SIZE;
+}
+
+const std::string& SharedMemoryChunk::get_name() const {
+    return name;
+}
+
+uint64_t SharedMemoryChunk::sequence() const {
+    return header->sequence.load();
+}
+
+void SharedMemoryChunk::begin_move() {
+    header->sequence.fetch_add(1); // Odd: offsets are about to change
+
+    // Stores already past their sequence check finish before anything moves
+    while (header->active_writers.load() != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void SharedMemoryChunk::end_move() {
+    header->sequence.fetch_add(1);
+}
@@ -0,0 +1,35 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "shm_layout.h"
+
+// Memory chunk backed by a POSIX shared-memory object, so clients on the same
+// host, running as the server's user, can map it and read or write blocks without
+// an RPC.
+class SharedMemoryChunk {
+private:
+    std::string name;
+    void* base = nullptr;
+    size_t mapped_size = 0;
+    ShmHeader* header = nullptr;
+
+public:
+    SharedMemoryChunk(const std::string& name, size_t data_size);
+    ~SharedMemoryChunk();
+
+    SharedMemoryChunk(const SharedMemoryChunk&) = delete;
+    SharedMemoryChunk& operator=(const SharedMemoryChunk&) = delete;
+
+    void* data() const;
+    const std::string& get_name() const;
+    uint64_t sequence() const;
+
+    // Brackets any change of block addresses (compaction)
+    void begin_move();
+    void end_move();
+};
+
+#endif // SHARED_MEMORY_H
@@ -0,0 +1,24 @@
+#ifndef SHM_LAYOUT_H
+#define SHM_LAYOUT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the shared-memory segment mem_mgr exports with --shm.
+// The header sits in the first page and the memory chunk starts right after it.
+//
+// Readers use the sequence as a seqlock: it is odd while the server moves blocks
+// and changes every time it does, so a block offset obtained through Locate is
+// only valid while the sequence still equals the one Locate returned.
+// Writers also register in active_writers; the server waits for it to drain
+// before moving anything, so a store never lands where another block moved to.
+struct ShmHeader {
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint32_t> active_writers;
+    uint64_t data_size;
+};
+
+constexpr size_t SHM_HEADER_SIZE = 4096;
+
+#endif // SHM_LAYOUT_H
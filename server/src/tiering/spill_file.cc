@@ -0,0 +1,107 @@
+#include "spill_file.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+SpillFile::SpillFile(const std::string& path) : path(path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open spill file " + path + ": " + std::strerror(errno));
+    }
+    std::cout << "Spilling cold blocks to " << path << std::endl;
+}
+
+SpillFile::~SpillFile() {
+    close(fd);
+    unlink(path.c_str());
+}
+
+bool SpillFile::write(const void* data, size_t size, size_t& offset) {
+    // First fit among the freed extents, else append
+    auto extent = free_extents.begin();
+    while (extent != free_extents.end() && extent->second < size) {
+        ++extent;
+    }
+    if (extent != free_extents.end()) {
+        offset = extent->first;
+        size_t rest = extent->second - size;
+        free_extents.erase(extent);
+        if (rest > 0) {
+            free_extents[offset + size] = rest;
+        }
+    } else {
+        offset = end;
+        end += size;
+    }
+
+    const char* bytes = static_cast<const char*>(data);
+    for (size_t written = 0; written < size;) {
+        ssize_t result = pwrite(fd, bytes + written, size - written, static_cast<off_t>(offset + written));
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Failed to write the spill file: " << std::strerror(errno) << std::endl;
+            release(offset, size);
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    used_bytes += size;
+    return true;
+}
+
+bool SpillFile::read(size_t offset, void* data, size_t size) const {
+    char* bytes = static_cast<char*>(data);
+    for (size_t done = 0; done < size;) {
+        ssize_t result = pread(fd, bytes + done, size - done, static_cast<off_t>(offset + done));
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            std::cerr << "Failed to read the spill file: " << (result == 0 ? "short read" : std::strerror(errno))
+                      << std::endl;
+            return false;
+        }
+        done += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+void SpillFile::release(size_t offset, size_t size) {
+    used_bytes -= std::min(used_bytes, size);
+
+    // Merge with the neighbouring free extents
+    auto next = free_extents.lower_bound(offset);
+    if (next != free_extents.end() && offset + size == next->first) {
+        size += next->second;
+        next = free_extents.erase(next);
+    }
+    if (next != free_extents.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            free_extents.erase(previous);
+        }
+    }
+
+    if (offset + size == end) {
+        // The tail is free: give it back to the file system
+        end = offset;
+        if (ftruncate(fd, static_cast<off_t>(end)) == -1) {
+            std::cerr << "Failed to shrink the spill file: " << std::strerror(errno) << std::endl;
+        }
+    } else {
+        free_extents[offset] = size;
+    }
+}
+
+size_t SpillFile::used() const {
+    return used_bytes;
+}
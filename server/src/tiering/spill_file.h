@@ -0,0 +1,38 @@
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+// On-disk home of evicted blocks, one extent per block. Freed extents are reused
+// first fit, and the file is truncated when its tail frees up.
+class SpillFile {
+public:
+    // Creates (or empties) the file at path
+    explicit SpillFile(const std::string& path);
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    // Writes size bytes and returns their offset in the file; false on an I/O error
+    bool write(const void* data, size_t size, size_t& offset);
+
+    // Reads back an extent returned by write()
+    bool read(size_t offset, void* data, size_t size) const;
+
+    // Makes an extent available again
+    void release(size_t offset, size_t size);
+
+    size_t used() const;
+
+private:
+    std::string path;
+    int fd;
+    size_t end = 0; // Bytes of the file in use, holes included
+    size_t used_bytes = 0;
+    std::map<size_t, size_t> free_extents; // Offset to length, coalesced
+};
+
+#endif // SPILL_FILE_H